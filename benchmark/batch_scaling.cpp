@@ -0,0 +1,77 @@
+/**
+ * Measures the throughput of `Program::runBatch` on many small messages with 1 up to one thread
+ * per core. Every message is a short list of key-value pairs that is parsed and evaluated to the
+ * sum of its values.
+ */
+
+#include <peg_parser/generator.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main() {
+  peg_parser::ParserGenerator<int> g;
+
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Key"] << "[a-z] [a-z0-9_]*";
+  g["Value"] << "[0-9]+" >> [](auto e) { return std::stoi(e.string()); };
+  g["Pair"] << "Key '=' Value" >> [](auto e) { return e[1].evaluate(); };
+  g.setStart(g["Message"] << "'{' Pair (',' Pair)* '}'" >> [](auto e) {
+    int sum = 0;
+    for (auto pair : e) {
+      sum += pair.evaluate();
+    }
+    return sum;
+  });
+
+  const size_t count = 200000;
+  std::vector<std::string> messages;
+  long long expected = 0;
+  for (size_t i = 0; i < count; ++i) {
+    std::string message = "{";
+    for (size_t j = 0; j < 4 + i % 5; ++j) {
+      message += (j > 0 ? ", field_" : "field_") + std::to_string(j) + " = "
+                 + std::to_string(i % 1000 + j);
+      expected += i % 1000 + j;
+    }
+    messages.push_back(message + "}");
+  }
+  std::vector<std::string_view> inputs(messages.begin(), messages.end());
+
+  double single = 0;
+  auto cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+  std::vector<size_t> threadCounts;
+  for (size_t threads = 1; threads < cores; threads *= 2) {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(cores);
+
+  for (auto threads : threadCounts) {
+    peg_parser::ThreadPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    auto results = g.runBatch(inputs, pool);
+    auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    long long sum = 0;
+    for (auto &result : results) {
+      sum += result.get();
+    }
+    if (sum != expected) {
+      std::cerr << "unexpected result with " << threads << " threads" << std::endl;
+      return 1;
+    }
+
+    if (threads == 1) {
+      single = duration.count();
+    }
+    std::cout << threads << " threads: " << duration.count() * 1000 << " ms ("
+              << count / duration.count() << " messages per second, speedup "
+              << single / duration.count() << ")" << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * Measures the throughput of many threads parsing small messages with one shared grammar, either
+ * through the `Parser`, which reference counts the rules of every syntax tree, or through a
+ * `FrozenParser`, whose parses do not write to shared memory. The frozen parser should scale
+ * almost linearly with the number of threads.
+ */
+
+#include <peg_parser/generator.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main() {
+  peg_parser::ParserGenerator<> g;
+
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Key"] << "[a-z] [a-z0-9_]*";
+  g["Value"] << "[0-9]+ | '\"' (!'\"' .)* '\"'";
+  g["Pair"] << "Key '=' Value";
+  g.setStart(g["Message"] << "'{' Pair (',' Pair)* '}'");
+
+  const size_t count = 200000;
+  std::vector<std::string> messages;
+  for (size_t i = 0; i < count; ++i) {
+    messages.push_back("{id = " + std::to_string(i) + ", name = \"message\", size = "
+                       + std::to_string(i % 1000) + "}");
+  }
+
+  auto frozen = g.parser.freeze();
+  auto cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+  std::vector<size_t> threadCounts;
+  for (size_t threads = 1; threads < cores; threads *= 2) {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(cores);
+
+  for (bool useFrozen : {false, true}) {
+    double single = 0;
+    for (auto threads : threadCounts) {
+      std::vector<std::thread> workers;
+      std::vector<size_t> failures(threads);
+      auto start = std::chrono::steady_clock::now();
+      for (size_t worker = 0; worker < threads; ++worker) {
+        workers.emplace_back([&, worker]() {
+          for (size_t i = worker; i < count; i += threads) {
+            auto tree = useFrozen ? frozen.parse(messages[i]) : g.parser.parse(messages[i]);
+            failures[worker] += !tree->valid;
+          }
+        });
+      }
+      for (auto &worker : workers) {
+        worker.join();
+      }
+      auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+      if (std::count(failures.begin(), failures.end(), 0) != long(threads)) {
+        std::cerr << "failed to parse messages" << std::endl;
+        return 1;
+      }
+
+      if (threads == 1) {
+        single = duration.count();
+      }
+      std::cout << (useFrozen ? "frozen parser, " : "parser, ") << threads
+                << " threads: " << count / duration.count() << " messages per second (speedup "
+                << single / duration.count() << ")" << std::endl;
+    }
+  }
+
+  return 0;
+}
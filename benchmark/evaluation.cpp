@@ -0,0 +1,66 @@
+/**
+ * Measures the time spent evaluating a parsed syntax tree, separately from parsing it. The input
+ * is a long sum of products, so most of the time is spent dispatching to the evaluators of small
+ * subtrees.
+ */
+
+#include <peg_parser/generator.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+int main() {
+  peg_parser::ParserGenerator<long long> g;
+
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Sum"] << "Product ('+' Product)*" >> [](auto e) {
+    long long sum = 0;
+    for (auto product : e) {
+      sum += product.evaluate();
+    }
+    return sum;
+  };
+  g["Product"] << "Number ('*' Number)*" >> [](auto e) {
+    long long product = 1;
+    for (auto number : e) {
+      product *= number.evaluate();
+    }
+    return product;
+  };
+  g["Number"] << "[0-9]+" >> [](auto e) {
+    long long value = 0;
+    for (auto c : e.view()) {
+      value = value * 10 + (c - '0');
+    }
+    return value;
+  };
+  g.setStart(g["Sum"]);
+
+  std::string input;
+  long long expected = 0;
+  for (int i = 0; i < 100000; ++i) {
+    input += (i > 0 ? " + " : "") + std::to_string(i % 100) + " * " + std::to_string(i % 7);
+    expected += (i % 100) * (i % 7);
+  }
+
+  auto tree = g.parse(input);
+  if (!tree->valid) {
+    std::cerr << "failed to parse input" << std::endl;
+    return 1;
+  }
+
+  const int repetitions = 20;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repetitions; ++i) {
+    if (g.interpret(tree).evaluate() != expected) {
+      std::cerr << "unexpected result" << std::endl;
+      return 1;
+    }
+  }
+  auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+  std::cout << "evaluation: " << duration.count() * 1000 / repetitions << " ms per tree"
+            << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+/**
+ * Compares evaluating a parsed syntax tree with `run` to evaluating while parsing with `runFused`,
+ * which replaces the children of every evaluated rule by its value on a stack instead of
+ * allocating syntax trees. The input is a long sum of products, so most of the time is spent on
+ * small subtrees.
+ */
+
+#include <peg_parser/generator.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+int main() {
+  peg_parser::ParserGenerator<long long> g;
+
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Sum"] << "Product ('+' Product)*" >> [](auto e) {
+    long long sum = 0;
+    for (auto product : e) {
+      sum += product.evaluate();
+    }
+    return sum;
+  };
+  g["Product"] << "Number ('*' Number)*" >> [](auto e) {
+    long long product = 1;
+    for (auto number : e) {
+      product *= number.evaluate();
+    }
+    return product;
+  };
+  g["Number"] << "[0-9]+" >> [](auto e) {
+    long long value = 0;
+    for (auto c : e.view()) {
+      value = value * 10 + (c - '0');
+    }
+    return value;
+  };
+  g.setStart(g["Sum"]);
+
+  std::string input;
+  long long expected = 0;
+  for (int i = 0; i < 100000; ++i) {
+    input += (i > 0 ? " + " : "") + std::to_string(i % 100) + " * " + std::to_string(i % 7);
+    expected += (i % 100) * (i % 7);
+  }
+
+  const int repetitions = 10;
+  peg_parser::ParseContext context;
+  for (bool fused : {false, true}) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; ++i) {
+      auto result = fused ? g.runFused(input, context) : g.run(input, context);
+      if (result != expected) {
+        std::cerr << "unexpected result" << std::endl;
+        return 1;
+      }
+    }
+    auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    std::cout << (fused ? "fused: " : "run: ") << duration.count() * 1000 / repetitions
+              << " ms per input" << std::endl;
+  }
+
+  return 0;
+}
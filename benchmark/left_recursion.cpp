@@ -0,0 +1,48 @@
+/**
+ * Measures the time needed to parse long left-associative expressions such as `1+2+3+...` with
+ * the left-recursive calculator grammar from the readme. As left-recursive seeds are grown in
+ * place, the time per term should stay constant as the expression gets longer.
+ */
+
+#include <peg_parser/generator.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+int main() {
+  peg_parser::ParserGenerator<float> g;
+
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Sum"] << "Add | Subtract | Product";
+  g["Product"] << "Multiply | Divide | Atomic";
+  g["Atomic"] << "Number | '(' Sum ')'";
+  g["Add"] << "Sum '+' Product";
+  g["Subtract"] << "Sum '-' Product";
+  g["Multiply"] << "Product '*' Atomic";
+  g["Divide"] << "Product '/' Atomic";
+  g["Number"] << "'-'? [0-9]+ ('.' [0-9]+)?";
+  g.setStart(g["Sum"]);
+
+  for (size_t terms : {1000, 10000, 100000}) {
+    std::string input = "1";
+    for (size_t i = 1; i < terms; ++i) {
+      input += i % 2 == 0 ? " + " : "-";
+      input += std::to_string(i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto tree = g.parse(input);
+    auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    if (!tree->valid || tree->end != input.size()) {
+      std::cerr << "failed to parse expression with " << terms << " terms" << std::endl;
+      return 1;
+    }
+
+    std::cout << terms << " terms: " << duration.count() * 1000 << " ms ("
+              << duration.count() * 1e9 / terms << " ns per term)" << std::endl;
+  }
+
+  return 0;
+}
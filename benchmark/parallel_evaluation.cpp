@@ -0,0 +1,90 @@
+/**
+ * Measures the evaluation of a large array of small records with `Expression::parallelMap` on
+ * thread pools of increasing size, compared to evaluating the records one after another. The
+ * records are independent, so the speedup should approach the number of threads.
+ */
+
+#include <peg_parser/generator.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main() {
+  using Expression = peg_parser::ParserGenerator<double>::Expression;
+  peg_parser::ThreadPool *pool = nullptr;
+
+  peg_parser::ParserGenerator<double> g;
+  g.setSeparator(g["Whitespace"] << "[\t\n ]");
+  g["Number"] << "'-'? [0-9]+ ('.' [0-9]+)?" >> [](auto e) { return std::stod(e.string()); };
+  g["Record"] << "'{' Number (',' Number)* '}'" >> [](auto e) {
+    std::vector<double> values;
+    for (auto number : e) {
+      values.push_back(number.evaluate());
+    }
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+  };
+  g["Array"] << "'[' Record (',' Record)* ']'" >> [&](auto e) {
+    double sum = 0;
+    if (pool) {
+      for (auto value : e.parallelMap([](const Expression &r) { return r.evaluate(); },
+                                      peg_parser::Interpreter<double>::parallelThreshold,
+                                      *pool)) {
+        sum += value;
+      }
+    } else {
+      for (auto record : e) {
+        sum += record.evaluate();
+      }
+    }
+    return sum;
+  };
+  g.setStart(g["Array"]);
+
+  std::string input = "[";
+  for (int i = 0; i < 20000; ++i) {
+    input += i > 0 ? ",\n{" : "{";
+    for (int j = 0; j < 20; ++j) {
+      input += (j > 0 ? ", " : "") + std::to_string((i * 37 + j * 11) % 1000) + ".5";
+    }
+    input += "}";
+  }
+  input += "]";
+
+  auto tree = g.parse(input);
+  if (!tree->valid) {
+    std::cerr << "failed to parse input" << std::endl;
+    return 1;
+  }
+
+  auto measure = [&]() {
+    const int repetitions = 5;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; ++i) {
+      g.interpret(tree).evaluate();
+    }
+    auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    return duration.count() * 1000 / repetitions;
+  };
+
+  auto sequential = measure();
+  std::cout << "sequential: " << sequential << " ms" << std::endl;
+  auto cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+  for (size_t threads = 1;; threads = std::min(threads * 2, cores)) {
+    peg_parser::ThreadPool threadPool(threads);
+    pool = &threadPool;
+    auto parallel = measure();
+    std::cout << "parallel, " << threads << " threads: " << parallel << " ms (speedup "
+              << sequential / parallel << ")" << std::endl;
+    pool = nullptr;
+    if (threads == cores) {
+      break;
+    }
+  }
+
+  return 0;
+}
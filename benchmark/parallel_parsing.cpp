@@ -0,0 +1,73 @@
+/**
+ * Measures the time needed to parse a single large JSON array with `Parser::parseParallel` with 1
+ * up to one thread per core. Every line of the input holds one object, which is used as the
+ * synchronization rule, candidates are located at the start of each line.
+ */
+
+#include <peg_parser/generator.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main() {
+  peg_parser::ParserGenerator<> g;
+
+  g.setSeparator(g["Separators"] << "[\t \n]");
+  g["JSON"] << "Number | String | Boolean | Array | Object | Empty";
+  g["Number"] << "'-'? [0-9]+ ('.' [0-9]+)?";
+  g["String"] << "'\"' (!'\"' .)* '\"'";
+  g["Boolean"] << "'true' | 'false'";
+  g["Empty"] << "'null'";
+  g["Array"] << "'[' (JSON (',' JSON)*)? ']'";
+  g["Pair"] << "String ':' JSON";
+  g["Object"] << "'{' (Pair (',' Pair)*)? '}'";
+  g.setStart(g["JSON"]);
+
+  g.setSynchronization(g["Object"]);
+  g.parser.synchronization.chunkSize = 1 << 16;
+  g.parser.synchronization.findCandidate = [](std::string_view input, size_t position) {
+    auto line = input.find('\n', position);
+    return line == std::string_view::npos ? input.size() : line + 1;
+  };
+
+  std::string input = "[";
+  for (size_t i = 0; i < 100000; ++i) {
+    input += i > 0 ? ",\n" : "\n";
+    input += "{\"id\": " + std::to_string(i)
+             + ", \"values\": [1, 2.5, true, null, \"text\"], \"nested\": {\"key\": -42}}";
+  }
+  input += "\n]";
+
+  double single = 0;
+  auto cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+  std::vector<size_t> threadCounts;
+  for (size_t threads = 1; threads < cores; threads *= 2) {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(cores);
+
+  for (auto threads : threadCounts) {
+    peg_parser::ThreadPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    auto result = g.parser.parseParallel(input, pool);
+    auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    if (!result.syntax->valid || result.syntax->end != input.size()) {
+      std::cerr << "failed to parse input with " << threads << " threads" << std::endl;
+      return 1;
+    }
+
+    if (threads == 1) {
+      single = duration.count();
+    }
+    std::cout << threads << " threads: " << duration.count() * 1000 << " ms ("
+              << input.size() / duration.count() / 1e6 << " MB/s, speedup "
+              << single / duration.count() << ")" << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+/**
+ * Compares a grammar compiled at build time by `static_grammar::compile` with the same grammar
+ * built at runtime by a `ParserGenerator`, on many small messages. The static grammar is used
+ * both as a recognizer and to build syntax trees.
+ */
+
+#include <peg_parser/generator.h>
+#include <peg_parser/static_grammar.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+  constexpr auto message = peg_parser::static_grammar::compile(R"(
+    Message <- '{' Pair (',' ' '* Pair)* '}'
+    Pair <- Key ' '* '=' ' '* Value
+    Key <- [a-z] [a-z0-9_]*
+    Value <- [0-9]+ | '"' (!'"' .)* '"'
+  )");
+
+  template <class F> double measure(const std::vector<std::string> &messages, F &&parse) {
+    auto start = std::chrono::steady_clock::now();
+    for (auto &m : messages) {
+      if (!parse(m)) {
+        std::cerr << "failed to parse " << m << std::endl;
+        std::exit(1);
+      }
+    }
+    auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    return messages.size() / duration.count();
+  }
+
+}  // namespace
+
+int main() {
+  peg_parser::ParserGenerator<> g;
+  g["Key"] << "[a-z] [a-z0-9_]*";
+  g["Value"] << "[0-9]+ | '\"' (!'\"' .)* '\"'";
+  g["Pair"] << "Key ' '* '=' ' '* Value";
+  g.setStart(g["Message"] << "'{' Pair (',' ' '* Pair)* '}'");
+
+  const size_t count = 200000;
+  std::vector<std::string> messages;
+  for (size_t i = 0; i < count; ++i) {
+    messages.push_back("{id = " + std::to_string(i) + ", name = \"message\", size = "
+                       + std::to_string(i % 1000) + "}");
+  }
+
+  peg_parser::ParseContext context;
+  std::cout << "runtime grammar: "
+            << measure(messages, [&](auto &m) { return g.parser.parse(m, context)->valid; })
+            << " messages per second" << std::endl;
+  std::cout << "static grammar: " << measure(messages, [](auto &m) {
+    return peg_parser::static_grammar::parse<message>(m)->valid;
+  }) << " messages per second" << std::endl;
+  std::cout << "static recognizer: " << measure(messages, [](auto &m) {
+    return peg_parser::static_grammar::match<message>(m) == m.size();
+  }) << " messages per second" << std::endl;
+
+  return 0;
+}
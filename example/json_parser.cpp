@@ -94,11 +94,11 @@ peg_parser::ParserGenerator<JSON> createJSONProgram() {
   g["Object"] << "'{' (Pair (',' Pair)*)? '}'" >> [](auto e) {
     std::map<std::string, JSON> data;
     for (auto p : e) {
-      data[std::get<std::string>(p[0].evaluate().data)] = p[1].evaluate();
+      data[std::get<std::string>(p["key"]->evaluate().data)] = p["value"]->evaluate();
     }
     return JSON(std::move(data));
   };
-  g["Pair"] << "String ':' JSON";
+  g["Pair"] << "key:String ':' value:JSON";
 
   // Empty
   g["Empty"] << "'null'" >> [](auto) { return JSON(); };
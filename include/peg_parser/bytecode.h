@@ -0,0 +1,186 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "grammar.h"
+#include "memoization.h"
+
+namespace peg_parser {
+
+  namespace bytecode {
+
+    /**
+     * A single instruction of the parsing machine. Combinators are lowered to
+     * backtracking instructions in the style of LPeg, jump targets are indices into
+     * `Program::instructions`.
+     */
+    struct Instruction {
+      enum class Opcode : std::uint8_t {
+        WORD,
+        ANY,
+        RANGE,
+        END_OF_FILE,
+        FILTER,
+        CALL,
+        RETURN,
+        CHOICE,
+        COMMIT,
+        PARTIAL_COMMIT,
+        BACK_COMMIT,
+        FAIL,
+        FAIL_TWICE,
+        INVALID_RULE,
+        SELECT,
+        SET,
+        SPAN,
+        SCAN,
+        KEYWORDS,
+        CUT,
+        END
+      };
+
+      /** argument of a `CUT` in the first iteration of `+`, which is committed already */
+      static constexpr std::uint32_t NO_CUT_TARGET = ~std::uint32_t(0);
+
+      Opcode opcode;
+      grammar::Letter from = 0, to = 0;
+      std::uint32_t argument = 0;
+
+      Instruction(Opcode o, std::uint32_t a = 0) : opcode(o), argument(a) {}
+      Instruction(Opcode o, grammar::Letter f, grammar::Letter t) : opcode(o), from(f), to(t) {}
+    };
+
+    /**
+     * The result of the lookahead analysis of a grammar node: the bytes a match can start with
+     * and whether the node can succeed without consuming input. Filters may consume arbitrary
+     * input and are treated as matching anything.
+     */
+    struct Lookahead {
+      std::bitset<256> first;
+      bool nullable = false;
+
+      bool operator==(const Lookahead &other) const {
+        return first == other.first && nullable == other.nullable;
+      }
+      bool operator!=(const Lookahead &other) const { return !(*this == other); }
+    };
+
+    /**
+     * Jump targets of a `SELECT` instruction indexed by the current byte, the last entry is used
+     * at the end of the input.
+     */
+    struct DispatchTable {
+      static constexpr std::uint32_t NO_ALTERNATIVE = ~std::uint32_t(0);
+      static constexpr size_t END_OF_INPUT = 256;
+      std::array<std::uint32_t, 257> targets;
+    };
+
+    /**
+     * A set of bytes matched by a single instruction. Runs of members are found by a vectorized
+     * kernel if the class consists of only a few ranges.
+     */
+    class CharacterClass {
+    public:
+      struct Range {
+        std::uint8_t from, to;
+      };
+
+    private:
+      std::array<bool, 256> table;
+      std::vector<Range> ranges;
+
+    public:
+      explicit CharacterClass(const std::bitset<256> &members);
+
+      bool contains(grammar::Letter c) const { return table[static_cast<unsigned char>(c)]; }
+
+      /** the end of the run of members in `string` starting at `position` */
+      size_t span(std::string_view string, size_t position) const;
+
+      const std::vector<Range> &getRanges() const { return ranges; }
+    };
+
+    /**
+     * The literals of an ordered choice, bucketed by their first byte. Within a bucket the
+     * literals keep their order in the choice, so the first one matching is the one the choice
+     * would have selected.
+     */
+    class KeywordTable {
+    public:
+      static constexpr size_t NO_MATCH = ~size_t(0);
+      /** returned for incomplete input if an alternative may still match once it continues */
+      static constexpr size_t NEEDS_INPUT = NO_MATCH - 1;
+
+    private:
+      std::array<std::uint32_t, 257> buckets;
+      std::vector<std::string> keywords;
+
+    public:
+      explicit KeywordTable(const std::vector<std::string> &alternatives);
+
+      /** the length of the first alternative matching at `position` or `NO_MATCH` */
+      size_t match(std::string_view string, size_t position, bool complete = true) const;
+
+      const std::vector<std::string> &getKeywords() const { return keywords; }
+    };
+
+    /**
+     * A grammar lowered into a contiguous instruction array. Rules are referenced by their
+     * index in `rules`, the start rule always has index 0.
+     */
+    struct Program {
+      struct RuleEntry {
+        std::shared_ptr<grammar::Rule> rule;
+        std::uint32_t entry;
+        /** the nodes of the rule's grammar in preorder, kept alive to detect replaced nodes */
+        std::vector<grammar::Node::Shared> nodes;
+        bool hidden;
+        bool cacheable;
+        Lookahead lookahead;
+        /** true if results are stored in the memo table, see `MemoizationPolicy` */
+        bool memoize;
+        /** the labeled captures of the rule, resolved against the compiled grammar */
+        std::vector<grammar::Label> labels;
+      };
+
+      std::vector<Instruction> instructions;
+      std::vector<RuleEntry> rules;
+      std::vector<std::string> words;
+      std::vector<grammar::Node::FilterCallback> filters;
+      std::vector<grammar::Node::Shared> invalidNodes;
+      std::vector<DispatchTable> dispatchTables;
+      std::vector<CharacterClass> characterClasses;
+      std::vector<KeywordTable> keywordTables;
+      MemoizationPolicy memoization;
+      /** the index of each rule in `rules` */
+      std::unordered_map<const grammar::Rule *, std::uint32_t> ruleIndices;
+
+      /** the labels of `rule`, or `nullptr` if it is not part of the program */
+      const std::vector<grammar::Label> *getLabels(const grammar::Rule &rule) const {
+        auto it = ruleIndices.find(&rule);
+        return it == ruleIndices.end() ? nullptr : &rules[it->second].labels;
+      }
+
+      /**
+       * True if the program still reflects the current state of the grammar. Nodes are compared
+       * by identity at every depth, so terminals must be replaced rather than modified in place.
+       */
+      bool isCompiledFrom(const std::shared_ptr<grammar::Rule> &start,
+                          const MemoizationPolicy &policy = MemoizationPolicy()) const;
+    };
+
+    std::shared_ptr<const Program> compile(const std::shared_ptr<grammar::Rule> &start,
+                                           const MemoizationPolicy &policy = MemoizationPolicy());
+
+    std::ostream &operator<<(std::ostream &stream, const Program &program);
+
+  }  // namespace bytecode
+}  // namespace peg_parser
@@ -35,9 +35,10 @@ namespace peg_parser {
 
     std::shared_ptr<grammar::Rule> setRule(
         const std::string &name, const grammar::Node::Shared &grammar,
-        const typename Interpreter<R, Args...>::Callback &callback
-        = typename Interpreter<R, Args...>::Callback()) {
+        const typename Interpreter<R, Args...>::Evaluator &callback
+        = typename Interpreter<R, Args...>::Evaluator()) {
       auto rule = getRule(name);
+      rule->labels = grammar::resolveLabels(grammar);
       rule->node = grammar;
       this->interpreter.setEvaluator(rule, callback);
       return rule;
@@ -50,8 +51,8 @@ namespace peg_parser {
 
     std::shared_ptr<grammar::Rule> setRule(
         const std::string &name, const std::string_view &grammar,
-        const typename Interpreter<R, Args...>::Callback &callback
-        = typename Interpreter<R, Args...>::Callback()) {
+        const typename Interpreter<R, Args...>::Evaluator &callback
+        = typename Interpreter<R, Args...>::Evaluator()) {
       return setRule(name, parseRule(grammar), callback);
     }
 
@@ -63,7 +64,7 @@ namespace peg_parser {
       this->interpreter.setEvaluator(
           rule, [callback = std::forward<C>(callback), interpreter = subprogram.interpreter](
                     auto e, Args &&...args) {
-            return callback(interpreter.interpret(e[0].syntax()), std::forward<Args>(args)...);
+            return callback(e[0].interpretBy(interpreter), std::forward<Args>(args)...);
           });
       return rule;
     }
@@ -76,15 +77,15 @@ namespace peg_parser {
       rule->node = grammar::Node::Rule(subprogram.parser.grammar);
       this->interpreter.setEvaluator(rule,
                                      [interpreter = subprogram.interpreter](auto e, auto &&...) {
-                                       return R(interpreter.interpret(e[0].syntax()).evaluate());
+                                       return R(e[0].interpretBy(interpreter).evaluate());
                                      });
     }
 
     std::shared_ptr<grammar::Rule> setFilteredRule(
         const std::string &name, const std::string_view &grammar,
         const grammar::Node::FilterCallback &filter,
-        const typename Interpreter<R, Args...>::Callback &callback
-        = typename Interpreter<R, Args...>::Callback()) {
+        const typename Interpreter<R, Args...>::Evaluator &callback
+        = typename Interpreter<R, Args...>::Evaluator()) {
       return setRule(name,
                      grammar::Node::Sequence({parseRule(grammar), grammar::Node::Filter(filter)}),
                      callback);
@@ -109,6 +110,11 @@ namespace peg_parser {
 
     void setStart(const std::shared_ptr<grammar::Rule> &rule) { this->parser.grammar = rule; }
 
+    /** sets the rule at which `Parser::parseParallel` splits the input */
+    void setSynchronization(const std::shared_ptr<grammar::Rule> &rule) {
+      this->parser.synchronization.rule = rule;
+    }
+
     void unsetSeparatorRule() { separatorRule.reset(); }
 
     /** Operator overloads */
@@ -117,7 +123,7 @@ namespace peg_parser {
       ParserGenerator *parent;
       std::string ruleName;
       std::string grammar;
-      typename Interpreter<R, Args...>::Callback callback;
+      typename Interpreter<R, Args...>::Evaluator callback;
       grammar::Node::FilterCallback filter;
 
       OperatorDelegate(ParserGenerator *p, const std::string &n) : parent(p), ruleName(n) {}
@@ -128,7 +134,7 @@ namespace peg_parser {
         return *this;
       }
 
-      OperatorDelegate &operator>>(const typename Interpreter<R, Args...>::Callback &cp) {
+      OperatorDelegate &operator>>(const typename Interpreter<R, Args...>::Evaluator &cp) {
         this->callback = cp;
         return *this;
       }
@@ -3,6 +3,7 @@
 #include <array>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <string>
 #include <unordered_map>
@@ -18,12 +19,65 @@ namespace peg_parser {
     using Letter = char;
     struct Node;
 
+    /**
+     * A labeled capture of a rule, resolved to the position of the captured child when a parser
+     * compiles the grammar. Optional captures are only present in trees with a fixed number of
+     * children.
+     */
+    struct Label {
+      std::string name;
+      /** the index of the child, counted backwards from the last child if `fromEnd` is set */
+      size_t offset = 0;
+      bool fromEnd = false;
+      /** the number of children of trees that contain an optional capture */
+      std::optional<size_t> presentSize;
+
+      /** the index of the captured child among `size` children, empty if it is absent */
+      std::optional<size_t> child(size_t size) const {
+        if (presentSize && size != *presentSize) {
+          return {};
+        }
+        return fromEnd ? size - 1 - offset : offset;
+      }
+
+      bool operator==(const Label &other) const {
+        return name == other.name && offset == other.offset && fromEnd == other.fromEnd
+               && presentSize == other.presentSize;
+      }
+      bool operator!=(const Label &other) const { return !(*this == other); }
+    };
+
+    /** the label called `name` among `labels`, or `nullptr` if there is none */
+    inline const Label *findLabel(const std::vector<Label> &labels, std::string_view name) {
+      for (auto &label : labels) {
+        if (label.name == name) {
+          return &label;
+        }
+      }
+      return nullptr;
+    }
+
     struct Rule {
       std::string name;
       std::shared_ptr<Node> node;
       bool hidden = false;
       bool cacheable = true;
-      Rule(const std::string_view &n, const std::shared_ptr<Node> &t) : name(n), node(t) {}
+      static constexpr size_t NO_SLOT = ~size_t(0);
+      /** the index of the rule's evaluator in the first interpreter it was registered with */
+      size_t slot = NO_SLOT;
+      /**
+       * The labeled captures of `node` as resolved when the rule has been set by a
+       * `ParserGenerator`. Expressions of a parse result use the labels of the compiled grammar
+       * instead, see `bytecode::Program::getLabels`, which follow later modifications.
+       */
+      std::vector<Label> labels;
+      Rule(const std::string_view &n, const std::shared_ptr<Node> &t);
+
+      /** the label called `label`, or `nullptr` if there is none */
+      const Label *findLabel(std::string_view label) const {
+        return grammar::findLabel(labels, label);
+      }
+
     };
 
     inline std::shared_ptr<Rule> makeRule(const std::string_view &name,
@@ -50,7 +104,9 @@ namespace peg_parser {
         RULE,
         WEAK_RULE,
         END_OF_FILE,
-        FILTER
+        FILTER,
+        CUT,
+        CAPTURE
       };
 
       using Shared = std::shared_ptr<Node>;
@@ -59,7 +115,7 @@ namespace peg_parser {
 
       std::variant<std::vector<Shared>, Shared, std::weak_ptr<grammar::Rule>,
                    std::shared_ptr<grammar::Rule>, std::string, std::array<Letter, 2>,
-                   FilterCallback>
+                   FilterCallback, std::pair<std::string, Shared>>
           data;
 
     private:
@@ -99,9 +155,28 @@ namespace peg_parser {
       static Shared Filter(const FilterCallback &callback) {
         return Shared(new Node(Symbol::FILTER, callback));
       }
+      /**
+       * Commits to the current alternative of the innermost enclosing choice, the current
+       * iteration of a repetition or the content of an optional node. Cuts without anything to
+       * commit, such as in the last alternative, are rejected when the grammar is compiled.
+       */
+      static Shared Cut() { return Shared(new Node(Symbol::CUT)); }
+      /** matches `arg` and labels the child it adds to the syntax tree */
+      static Shared Capture(const std::string &label, const Shared &arg) {
+        return Shared(new Node(Symbol::CAPTURE, std::make_pair(label, arg)));
+      }
     };
 
     std::ostream &operator<<(std::ostream &stream, const Node &node);
 
+    /**
+     * Resolves the labeled captures of a rule's grammar to the positions of their children.
+     * Captures must be part of the rule's top-level sequence and add at most one child. Each needs
+     * a fixed number of children either before or after it, optional captures also need a fixed
+     * number everywhere else. Rules referenced from `node` count as one child unless hidden.
+     * Throws a `Parser::GrammarError` if a capture cannot be resolved.
+     */
+    std::vector<Label> resolveLabels(const Node::Shared &node);
+
   }  // namespace grammar
 }  // namespace peg_parser
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <exception>
 #include <iterator>
 #include <optional>
+#include <tuple>
 #include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 #include "parser.h"
 
@@ -10,17 +14,89 @@ namespace peg_parser {
 
   struct InterpreterError : public std::exception {
     std::shared_ptr<SyntaxTree> tree;
+    std::shared_ptr<grammar::Rule> rule;
     mutable std::string buffer;
-    InterpreterError(const std::shared_ptr<SyntaxTree> &t) : tree(t) {}
+    InterpreterError(const std::shared_ptr<SyntaxTree> &t) : tree(t), rule(t->rule) {}
+    InterpreterError(const std::shared_ptr<grammar::Rule> &r) : rule(r) {}
     const char *what() const noexcept override;
   };
 
   template <class R, typename... Args> class Interpreter {
   public:
     class Expression;
+    class Reducer;
+
+    /** the input length below which `Expression::parallelMap` does not use the thread pool */
+    static constexpr size_t parallelThreshold = 4096;
     using Callback = std::function<R(const Expression &e, Args... args)>;
+    using Function = R (*)(const Expression &e, Args... args);
+
+    /**
+     * The evaluator of a rule. Callables that convert to a plain function pointer, such as
+     * lambdas without captures, are called directly instead of through a `Callback`.
+     */
+    class Evaluator {
+    private:
+      Function function = nullptr;
+      Callback callback;
+
+    public:
+      Evaluator() = default;
+      template <class F, class = typename std::enable_if<
+                             !std::is_same<typename std::decay<F>::type, Evaluator>::value
+                             && std::is_convertible<F, Callback>::value>::type>
+      Evaluator(F &&f) {
+        if constexpr (std::is_convertible<F, Function>::value) {
+          function = f;
+        } else {
+          callback = std::forward<F>(f);
+        }
+      }
+
+      explicit operator bool() const { return function || callback; }
 
+      R operator()(const Expression &e, Args... args) const {
+        if (function) {
+          return function(e, std::forward<Args>(args)...);
+        }
+        return callback(e, std::forward<Args>(args)...);
+      }
+    };
+
+    /**
+     * A rule invocation reduced while parsing, see `Reducer`. Invocations of rules with an
+     * evaluator hold its value and have released their children, the others keep their children.
+     */
+    struct Reduction {
+      using Value = typename std::conditional<std::is_void<R>::value, bool, R>::type;
+
+      grammar::Rule *rule;
+      std::string_view fullString;
+      size_t begin, end;
+      /** empty until evaluated, and again once a value that cannot be copied has been taken */
+      std::optional<Value> value;
+      bool evaluated = false;
+      std::vector<Reduction> children;
+      /** the memoized tree of the invocation, its value is kept once it leaves the stack */
+      const SyntaxTree *memoized = nullptr;
+      /** set if the value has been moved out of the side table, as it cannot be copied */
+      bool recalled = false;
+      /** the number of retired reductions once this one has been pushed, see `Reducer` */
+      size_t retiredCount = 0;
+
+      Reduction(grammar::Rule *r, std::string_view s, size_t b, size_t e)
+          : rule(r), fullString(s), begin(b), end(e) {}
+    };
+
+    /**
+     * A syntax tree node together with the interpreter evaluating it. Expressions of a
+     * `SyntaxTree` own their tree, the expressions of a `CompactSyntaxTree` or of a `Reducer`
+     * refer to it and must not outlive it.
+     */
     class Expression {
+      friend class Interpreter<R, Args...>;
+      friend class Interpreter<R, Args...>::Reducer;
+
     protected:
       struct iterator {
         using iterator_category = std::input_iterator_tag;
@@ -43,52 +119,253 @@ namespace peg_parser {
 
       const Interpreter<R, Args...> &interpreter;
       std::shared_ptr<SyntaxTree> syntaxTree;
+      const CompactSyntaxTree *compactTree = nullptr;
+      CompactSyntaxTree::Index node = 0;
+      Reduction *reduction = nullptr;
+      /** the compiled grammar resolving labels, the labels of the rules are used if unset */
+      const bytecode::Program *program = nullptr;
+
+      Expression(const Interpreter<R, Args...> &i, Reduction *r, const bytecode::Program *p)
+          : interpreter(i), reduction(r), program(p) {}
+
+      const std::shared_ptr<SyntaxTree> &tree() const { return syntaxTree; }
+
+      grammar::Rule *rulePointer() const {
+        if (reduction) {
+          return reduction->rule;
+        }
+        return compactTree ? compactTree->getRule(node).get() : tree()->rule.get();
+      }
+
+      const grammar::Label *findLabel(std::string_view name) const {
+        auto rule = rulePointer();
+        if (program) {
+          if (auto labels = program->getLabels(*rule)) {
+            return grammar::findLabel(*labels, name);
+          }
+        }
+        return rule->findLabel(name);
+      }
+
+      InterpreterError error() const {
+        if (reduction) {
+          return InterpreterError(rule());
+        }
+        return compactTree ? InterpreterError(compactTree->getRule(node))
+                           : InterpreterError(tree());
+      }
+
+      /** a syntax tree of a reduction without values, to be evaluated by other interpreters */
+      static std::shared_ptr<SyntaxTree> toSyntaxTree(const Reduction &reduction) {
+        std::shared_ptr<grammar::Rule> rule(std::shared_ptr<void>(), reduction.rule);
+        if (reduction.evaluated) {
+          throw InterpreterError(rule);
+        }
+        auto tree = std::make_shared<SyntaxTree>(rule, reduction.fullString, reduction.begin);
+        tree->end = reduction.end;
+        tree->valid = true;
+        tree->active = false;
+        for (auto &child : reduction.children) {
+          tree->inner.push_back(toSyntaxTree(child));
+        }
+        return tree;
+      }
 
     public:
-      Expression(const Interpreter<R, Args...> &i, std::shared_ptr<SyntaxTree> s)
-          : interpreter(i), syntaxTree(s) {}
+      /** labels are looked up in `p`, the compiled grammar that has parsed `s`, if it is set */
+      Expression(const Interpreter<R, Args...> &i, std::shared_ptr<SyntaxTree> s,
+                 const bytecode::Program *p = nullptr)
+          : interpreter(i), syntaxTree(std::move(s)), program(p) {}
+      Expression(const Interpreter<R, Args...> &i, const CompactSyntaxTree &t,
+                 CompactSyntaxTree::Index n)
+          : interpreter(i), compactTree(&t), node(n) {}
 
-      auto size() const { return syntaxTree->inner.size(); }
-      auto view() const { return syntaxTree->view(); }
+      size_t size() const {
+        if (reduction) {
+          return reduction->children.size();
+        }
+        return compactTree ? compactTree->childCount[node] : tree()->inner.size();
+      }
+      std::string_view view() const {
+        if (reduction) {
+          return reduction->fullString.substr(reduction->begin, length());
+        }
+        return compactTree ? compactTree->view(node) : tree()->view();
+      }
       auto string() const { return std::string(view()); }
-      auto position() const { return syntaxTree->begin; }
-      auto length() const { return syntaxTree->length(); }
-      auto rule() const { return syntaxTree->rule; }
-      auto syntax() const { return syntaxTree; }
+      size_t position() const {
+        if (reduction) {
+          return reduction->begin;
+        }
+        return compactTree ? compactTree->begin(node) : tree()->begin;
+      }
+      size_t length() const {
+        if (reduction) {
+          return reduction->end - reduction->begin;
+        }
+        return compactTree ? compactTree->length(node) : tree()->length();
+      }
+      std::shared_ptr<grammar::Rule> rule() const {
+        if (reduction) {
+          // rules outlive the parse that has reduced them
+          return std::shared_ptr<grammar::Rule>(std::shared_ptr<void>(), reduction->rule);
+        }
+        return compactTree ? compactTree->getRule(node) : tree()->rule;
+      }
+      /**
+       * The evaluated syntax tree, empty for expressions of a `CompactSyntaxTree` and for
+       * expressions reduced while parsing
+       */
+      std::shared_ptr<SyntaxTree> syntax() const { return tree(); }
 
       Expression operator[](size_t idx) const {
-        return interpreter.interpret(syntaxTree->inner[idx]);
+        if (reduction) {
+          return Expression(interpreter, &reduction->children[idx], program);
+        }
+        if (compactTree) {
+          return Expression(interpreter, *compactTree, compactTree->child(node, idx));
+        }
+        return Expression(interpreter, tree()->inner[idx], program);
       }
+      /** the child captured by the label `name` or else the first child of the rule `name` */
       std::optional<Expression> operator[](std::string_view name) const {
-        auto it = std::find_if(syntaxTree->inner.begin(), syntaxTree->inner.end(),
-                               [name](auto st) { return st->rule->name == name; });
-        if (it != syntaxTree->inner.end()) {
-          return interpreter.interpret(*it);
+        if (auto label = findLabel(name)) {
+          return (*this)[*label];
+        }
+        for (size_t i = 0; i < size(); ++i) {
+          grammar::Rule *rule;
+          if (reduction) {
+            rule = reduction->children[i].rule;
+          } else if (compactTree) {
+            rule = compactTree->getRule(compactTree->child(node, i)).get();
+          } else {
+            rule = tree()->inner[i]->rule.get();
+          }
+          if (rule->name == name) {
+            return (*this)[i];
+          }
+        }
+        return {};
+      }
+      /** the child captured by `label`, a label of the expression's rule */
+      std::optional<Expression> operator[](const grammar::Label &label) const {
+        if (auto index = label.child(size())) {
+          return (*this)[*index];
         }
         return {};
       }
       iterator begin() const { return iterator(*this, 0); }
       iterator end() const { return iterator(*this, size()); }
 
+      /**
+       * Calls `f` for every child on the workers of `pool` and returns the results in child
+       * order. Expressions shorter than `minimumLength` characters are mapped sequentially, as
+       * are expressions mapped from within another parallel map. `f` and the evaluators it calls
+       * must be safe to call concurrently.
+       */
+      template <class F> auto parallelMap(F &&f, size_t minimumLength = parallelThreshold,
+                                          ThreadPool &pool = ThreadPool::shared()) const {
+        using T = std::invoke_result_t<F &, const Expression &>;
+        auto count = size();
+        auto run = [&](auto &&task) {
+          if (length() < minimumLength) {
+            for (size_t index = 0; index < count; ++index) {
+              task(index, 0);
+            }
+          } else {
+            pool.run(count, task);
+          }
+        };
+        if constexpr (std::is_void<T>::value) {
+          run([&](size_t index, size_t) { f((*this)[index]); });
+        } else if constexpr (std::is_default_constructible<T>::value) {
+          std::vector<T> results(count);
+          run([&](size_t index, size_t) { results[index] = f((*this)[index]); });
+          return results;
+        } else {
+          std::vector<std::optional<T>> values(count);
+          run([&](size_t index, size_t) { values[index].emplace(f((*this)[index])); });
+          std::vector<T> results;
+          results.reserve(count);
+          for (auto &value : values) {
+            results.push_back(std::move(*value));
+          }
+          return results;
+        }
+      }
+
+      /** evaluates all children in parallel, see `parallelMap` */
+      auto parallelEvaluate(Args... args) const {
+        return parallelMap([&](const Expression &e) { return e.evaluate(args...); });
+      }
+
+      /**
+       * The same expression, evaluated by another interpreter. Expressions reduced while parsing
+       * are copied to a syntax tree, which fails if they contain values.
+       */
+      template <class R2, typename... Args2>
+      auto interpretBy(const Interpreter<R2, Args2...> &other) const {
+        if (reduction) {
+          return other.interpret(toSyntaxTree(*reduction));
+        }
+        return compactTree ? other.interpret(*compactTree, node) : other.interpret(tree());
+      }
+
       template <class R2, typename... Args2>
       auto evaluateBy(const Interpreter<R2, Args2...> &interpreter, Args2... args) const {
-        return interpreter.evaluate(syntaxTree, args...);
+        return interpretBy(interpreter).evaluate(args...);
       }
 
       R evaluate(Args... args) const {
-        auto it = interpreter.evaluators.find(syntaxTree->rule.get());
-        if (it == interpreter.evaluators.end()) {
-          if (interpreter.defaultEvaluator) {
-            return interpreter.defaultEvaluator(*this, args...);
+        if (reduction && reduction->evaluated) {
+          if (!reduction->value) {
+            // taken by an earlier call
+            throw error();
+          }
+          if constexpr (std::is_void<R>::value) {
+            return;
+          } else if constexpr (std::is_copy_constructible<R>::value) {
+            return *reduction->value;
+          } else {
+            R value = std::move(*reduction->value);
+            reduction->value.reset();
+            return value;
           }
-          throw InterpreterError(syntaxTree);
         }
-        return it->second(*this, args...);
+        if (auto evaluator = interpreter.findEvaluator(*rulePointer())) {
+          return (*evaluator)(*this, args...);
+        }
+        if (interpreter.defaultEvaluator) {
+          return interpreter.defaultEvaluator(*this, args...);
+        }
+        throw error();
       }
     };
 
   private:
-    std::unordered_map<grammar::Rule *, Callback> evaluators;
+    struct Slot {
+      std::shared_ptr<grammar::Rule> rule;
+      Evaluator evaluator;
+    };
+
+    /** the evaluators indexed by `Rule::slot`, for the rules first registered here */
+    std::vector<Slot> slots;
+    /** the evaluators of rules whose slot belongs to another interpreter */
+    std::unordered_map<const grammar::Rule *, Slot> sharedRules;
+
+    const Evaluator *findEvaluator(const grammar::Rule &rule) const {
+      if (rule.slot < slots.size() && slots[rule.slot].rule.get() == &rule) {
+        auto &evaluator = slots[rule.slot].evaluator;
+        return evaluator ? &evaluator : nullptr;
+      }
+      if (!sharedRules.empty()) {
+        auto it = sharedRules.find(&rule);
+        if (it != sharedRules.end()) {
+          return &it->second.evaluator;
+        }
+      }
+      return nullptr;
+    }
 
     static R __defaultEvaluator(const Expression &e, Args... args) {
       size_t N = e.size();
@@ -99,7 +376,10 @@ namespace peg_parser {
         return e[N - 1].evaluate(std::forward<Args>(args)...);
       }
       if (!std::is_same<R, void>::value) {
-        throw InterpreterError(e.syntax());
+        if (e.syntax()) {
+          throw InterpreterError(e.syntax());
+        }
+        throw InterpreterError(e.rule());
       }
     };
 
@@ -108,7 +388,7 @@ namespace peg_parser {
 
     std::shared_ptr<grammar::Rule> makeRule(const std::string_view &name,
                                             const grammar::Node::Shared &node,
-                                            const Callback &callback) {
+                                            const Evaluator &callback) {
       auto rule = std::make_shared<grammar::Rule>(name, node);
       setEvaluator(rule, callback);
       return rule;
@@ -116,18 +396,24 @@ namespace peg_parser {
 
     std::shared_ptr<grammar::Rule> makeRule(const std::string &name,
                                             const std::shared_ptr<grammar::Rule> &rule,
-                                            const Callback &callback) {
+                                            const Evaluator &callback) {
       return makeRule(name, grammar::Node::Rule(rule), callback);
     }
 
-    void setEvaluator(const std::shared_ptr<grammar::Rule> &rule, const Callback &callback) {
-      if (callback) {
-        evaluators[rule.get()] = callback;
+    /**
+     * Sets the evaluator of `rule`. Rules receive their slot from the first interpreter that
+     * registers them, so the slots of a grammar stay dense however many rules exist elsewhere.
+     */
+    void setEvaluator(const std::shared_ptr<grammar::Rule> &rule, const Evaluator &evaluator) {
+      if (rule->slot < slots.size() && slots[rule->slot].rule == rule) {
+        slots[rule->slot].evaluator = evaluator;
+      } else if (!evaluator) {
+        sharedRules.erase(rule.get());
+      } else if (rule->slot == grammar::Rule::NO_SLOT) {
+        rule->slot = slots.size();
+        slots.push_back(Slot{rule, evaluator});
       } else {
-        auto it = evaluators.find(rule.get());
-        if (it != evaluators.end()) {
-          evaluators.erase(it);
-        }
+        sharedRules[rule.get()] = Slot{rule, evaluator};
       }
     }
 
@@ -135,9 +421,173 @@ namespace peg_parser {
       return Expression{*this, tree};
     }
 
+    /** the expression of `tree`, whose labels are looked up in `program`, which has parsed it */
+    Expression interpret(const std::shared_ptr<SyntaxTree> &tree,
+                         const bytecode::Program &program) const {
+      return Expression{*this, tree, &program};
+    }
+
     R evaluate(const std::shared_ptr<SyntaxTree> &tree, Args... args) const {
       return interpret(tree).evaluate(args...);
     }
+
+    Expression interpret(const CompactSyntaxTree &tree, CompactSyntaxTree::Index node = 0) const {
+      return Expression{*this, tree, node};
+    }
+
+    R evaluate(const CompactSyntaxTree &tree, Args... args) const {
+      return interpret(tree).evaluate(args...);
+    }
+
+    /**
+     * Evaluates rule invocations while they are parsed, see `Parser::parseAndReduce`. The values
+     * are kept on a stack that is truncated when the parser backtracks, invocations of rules
+     * without evaluator keep their children and are evaluated once their value is requested.
+     */
+    class Reducer final : public Parser::Reducer {
+    private:
+      const Interpreter &interpreter;
+      std::string_view string;
+      std::tuple<Args &...> args;
+      std::vector<Reduction> stack;
+      /**
+       * The children of evaluated invocations that may still be recalled, kept until their
+       * parent leaves the stack. Values can only be recalled once the parser has backtracked
+       * past their parent, so this avoids the side table for most memoized invocations.
+       */
+      std::vector<Reduction> retired;
+      /** the reductions of memoized invocations, keyed by their memoized tree */
+      std::unordered_map<const SyntaxTree *, Reduction> memoized;
+      /** released children lists, reused to avoid an allocation per evaluated invocation */
+      std::vector<std::vector<Reduction>> spare;
+
+      /**
+       * Keeps the values of memoized invocations that leave the stack in the side table. Values
+       * that cannot be copied are kept with their ancestors only.
+       */
+      void release(Reduction &reduction, bool discarded = true) {
+        auto key = reduction.memoized;
+        if constexpr (std::is_copy_constructible<Reduction>::value) {
+          for (auto &child : reduction.children) {
+            release(child, discarded && !key);
+          }
+          if (key) {
+            reduction.memoized = nullptr;
+            if (discarded) {
+              memoized.insert_or_assign(key, std::move(reduction));
+            } else {
+              memoized.insert_or_assign(key, reduction);
+            }
+          }
+        } else if (key) {
+          reduction.memoized = nullptr;
+          if (reduction.recalled) {
+            // the tree may have been memoized again meanwhile
+            memoized.emplace(key, std::move(reduction));
+          } else {
+            memoized.insert_or_assign(key, std::move(reduction));
+          }
+        } else {
+          for (auto &child : reduction.children) {
+            release(child);
+          }
+        }
+      }
+
+      void push(Reduction reduction) {
+        reduction.retiredCount = retired.size();
+        stack.push_back(std::move(reduction));
+      }
+
+    public:
+      Reducer(const Interpreter &i, const std::string_view &s, Args &...a)
+          : interpreter(i), string(s), args(a...) {}
+
+      void reduce(const std::shared_ptr<grammar::Rule> &rule, size_t begin, size_t end,
+                  size_t count) override {
+        auto first = stack.end() - count;
+        Reduction reduction(rule.get(), string, begin, end);
+        if (!spare.empty()) {
+          reduction.children = std::move(spare.back());
+          spare.pop_back();
+        }
+        reduction.children.insert(reduction.children.end(), std::make_move_iterator(first),
+                                  std::make_move_iterator(stack.end()));
+        stack.erase(first, stack.end());
+        if (auto evaluator = interpreter.findEvaluator(*rule)) {
+          Expression expression(interpreter, &reduction, program);
+          auto call = [&](auto &...a) { return (*evaluator)(expression, a...); };
+          if constexpr (std::is_void<R>::value) {
+            std::apply(call, args);
+            reduction.value = true;
+          } else {
+            reduction.value = std::apply(call, args);
+          }
+          reduction.evaluated = true;
+          for (auto &child : reduction.children) {
+            if (child.memoized || !child.children.empty()) {
+              retired.push_back(std::move(child));
+            }
+          }
+          reduction.children.clear();
+          spare.push_back(std::move(reduction.children));
+        }
+        push(std::move(reduction));
+      }
+
+      void truncate(size_t size) override {
+        if (stack.size() <= size) {
+          return;
+        }
+        auto first = retired.begin() + (size > 0 ? stack[size - 1].retiredCount : 0);
+        for (auto it = first; it != retired.end(); ++it) {
+          release(*it);
+        }
+        retired.erase(first, retired.end());
+        while (stack.size() > size) {
+          release(stack.back());
+          stack.pop_back();
+        }
+      }
+
+      void memoize(const SyntaxTree &tree) override { stack.back().memoized = &tree; }
+
+      /**
+       * Memoized invocations are only reused once the parser has backtracked past them, so their
+       * values have left the stack and are found in the side table.
+       */
+      void recall(const SyntaxTree &tree) override {
+        auto it = memoized.find(&tree);
+        if constexpr (std::is_copy_constructible<Reduction>::value) {
+          if (it != memoized.end()) {
+            push(it->second);
+            return;
+          }
+        } else if (it != memoized.end()) {
+          push(std::move(it->second));
+          stack.back().memoized = &tree;
+          stack.back().recalled = true;
+          memoized.erase(it);
+          return;
+        }
+        // taken by an invocation that has been reduced
+        Reduction taken(tree.rule.get(), string, tree.begin, tree.end);
+        taken.evaluated = true;
+        push(std::move(taken));
+      }
+
+      /** the expression of the invocation that has produced `tree`, the result of the parse */
+      Expression interpret(const SyntaxTree &tree) {
+        if (!stack.empty() && stack.back().memoized == &tree) {
+          return Expression(interpreter, &stack.back(), program);
+        }
+        auto it = memoized.find(&tree);
+        if (it == memoized.end()) {
+          throw InterpreterError(tree.rule);
+        }
+        return Expression(interpreter, &it->second, program);
+      }
+    };
   };
 
   class SyntaxError : public std::exception {
@@ -146,17 +596,56 @@ namespace peg_parser {
 
   public:
     std::shared_ptr<SyntaxTree> syntax;
+    /** the furthest failure, if the input has been diagnosed */
+    std::optional<Parser::Diagnosis> diagnosis;
 
     SyntaxError(const std::shared_ptr<SyntaxTree> &t) : syntax(t) {}
+    SyntaxError(const std::shared_ptr<SyntaxTree> &t, Parser::Diagnosis d)
+        : syntax(t), diagnosis(std::move(d)) {}
     const char *what() const noexcept override;
   };
 
+  /** the value of an input of `Program::runBatch` or the exception it has raised */
+  template <class R> struct BatchResult {
+    std::optional<R> value;
+    std::exception_ptr error;
+
+    /** the value, rethrows the error if there is one */
+    R &get() {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+      return *value;
+    }
+  };
+
+  template <> struct BatchResult<void> {
+    std::exception_ptr error;
+
+    void get() const {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
+  };
+
+  /**
+   * A parser together with the evaluators of its rules. Running a program is thread-safe under
+   * the conditions of `Parser`, provided that the evaluators can be called concurrently.
+   */
   template <class R, typename... Args> struct Program {
     using Expression = typename Interpreter<R, Args...>::Expression;
 
     Parser parser;
     Interpreter<R, Args...> interpreter;
 
+    /**
+     * If set, rejected inputs are parsed again by `Parser::diagnose` and the expected rules and
+     * terminals are attached to the thrown `SyntaxError`. Otherwise the error only refers to the
+     * furthest failed rule invocation, which avoids the second parse.
+     */
+    bool diagnoseErrors = false;
+
     std::shared_ptr<SyntaxTree> parse(const std::string_view &str) const {
       return parser.parse(str);
     }
@@ -168,12 +657,110 @@ namespace peg_parser {
       return interpreter.interpret(tree);
     }
 
+    /** the expression of a parse result, its labels are those of the grammar that was parsed */
+    Expression interpret(const Parser::Result &parsed) const {
+      if (!parsed.program) {
+        return interpret(parsed.syntax);
+      }
+      if (!parsed.syntax->valid) {
+        throw SyntaxError(parsed.syntax);
+      }
+      return interpreter.interpret(parsed.syntax, *parsed.program);
+    }
+
     R run(const std::string_view &str, Args &&...args) const {
       auto parsed = parser.parseAndGetError(str);
       if (!parsed.syntax->valid || parsed.syntax->end < str.size()) {
-        throw SyntaxError(parsed.error);
+        reject(parsed, str);
+      }
+      return interpret(parsed).evaluate(std::forward<Args>(args)...);
+    }
+
+    /** parses and evaluates `str` reusing the memory of `context` */
+    R run(const std::string_view &str, ParseContext &context, Args &&...args) const {
+      auto parsed = parser.parseAndGetError(str, context);
+      if (!parsed.syntax->valid || parsed.syntax->end < str.size()) {
+        reject(parsed, str);
+      }
+      return interpret(parsed).evaluate(std::forward<Args>(args)...);
+    }
+
+    /**
+     * Evaluates `str` while parsing it, without building the complete syntax tree, see
+     * `Interpreter::Reducer`. Every evaluator receives `args` and is called as soon as its rule
+     * has been parsed, possibly for invocations discarded by backtracking later, so evaluators
+     * must not have side effects. Evaluators can read the children of their expression and
+     * their values, but not the children of children that have an evaluator themselves.
+     */
+    R runFused(const std::string_view &str, Args &&...args) const {
+      typename Interpreter<R, Args...>::Reducer reducer(interpreter, str, args...);
+      auto parsed = parser.parseAndReduce(str, reducer);
+      if (!parsed.syntax->valid || parsed.syntax->end < str.size()) {
+        reject(parsed, str);
+      }
+      return reducer.interpret(*parsed.syntax).evaluate(std::forward<Args>(args)...);
+    }
+
+    /** evaluates `str` while parsing it reusing the memory of `context`, see `runFused` */
+    R runFused(const std::string_view &str, ParseContext &context, Args &&...args) const {
+      typename Interpreter<R, Args...>::Reducer reducer(interpreter, str, args...);
+      auto parsed = parser.parseAndReduce(str, context, reducer);
+      if (!parsed.syntax->valid || parsed.syntax->end < str.size()) {
+        reject(parsed, str);
+      }
+      return reducer.interpret(*parsed.syntax).evaluate(std::forward<Args>(args)...);
+    }
+
+    /** parses and evaluates the file at `path`, see `Parser::parseFile` */
+    R runFile(const std::string &path, Args &&...args) const {
+      auto parsed = parser.parseFile(path);
+      if (!parsed.syntax->valid || parsed.syntax->end < parsed.syntax->fullString.size()) {
+        reject(parsed, parsed.syntax->fullString);
+      }
+      return interpret(parsed).evaluate(std::forward<Args>(args)...);
+    }
+
+    /**
+     * Parses and evaluates all `inputs` on the workers of `pool`, see `Parser::parseBatch`. The
+     * results are returned in input order, errors are stored instead of thrown. The arguments
+     * are shared by all workers and evaluators must be safe to call concurrently.
+     */
+    std::vector<BatchResult<R>> runBatch(const std::vector<std::string_view> &inputs,
+                                         ThreadPool &pool, Args... args) const {
+      std::vector<BatchResult<R>> results(inputs.size());
+      parser.parseBatch(
+          inputs,
+          [&](size_t index, Parser::Result &parsed) {
+            auto &result = results[index];
+            try {
+              if (!parsed.syntax->valid || parsed.syntax->end < inputs[index].size()) {
+                reject(parsed, inputs[index]);
+              }
+              if constexpr (std::is_void<R>::value) {
+                interpret(parsed).evaluate(args...);
+              } else {
+                result.value.emplace(interpret(parsed).evaluate(args...));
+              }
+            } catch (...) {
+              result.error = std::current_exception();
+            }
+          },
+          pool);
+      return results;
+    }
+
+    /** parses and evaluates all `inputs` on the shared thread pool */
+    std::vector<BatchResult<R>> runBatch(const std::vector<std::string_view> &inputs,
+                                         Args... args) const {
+      return runBatch(inputs, ThreadPool::shared(), args...);
+    }
+
+  private:
+    [[noreturn]] void reject(const Parser::Result &parsed, const std::string_view &str) const {
+      if (diagnoseErrors) {
+        throw SyntaxError(parsed.error, parser.diagnose(str));
       }
-      return interpret(parsed.syntax).evaluate(std::forward<Args>(args)...);
+      throw SyntaxError(parsed.error);
     }
   };
 
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+namespace peg_parser {
+
+  /**
+   * Memo table statistics per rule name, gathered by `Parser::parseAndProfile` on a sample
+   * corpus. Profiles can be stored and loaded to configure adaptive memoization.
+   */
+  struct MemoizationProfile {
+    struct Entry {
+      size_t invocations = 0;
+      /** invocations answered by the memo table */
+      size_t hits = 0;
+    };
+
+    std::unordered_map<std::string, Entry> rules;
+
+    /** writes one `invocations hits name` line per rule */
+    void save(std::ostream &stream) const;
+    void load(std::istream &stream);
+
+    void saveFile(const std::string &path) const;
+    static MemoizationProfile loadFile(const std::string &path);
+  };
+
+  /**
+   * Selects the rules whose results are stored in the memo table. Rules with `cacheable` unset
+   * are never memoized, left-recursive rules are always memoized as the memo table is needed to
+   * grow their seeds.
+   */
+  struct MemoizationPolicy {
+    enum class Mode {
+      /** no memoization apart from left-recursive rules, may take exponential time */
+      NONE,
+      /** every rule, guarantees linear time for grammars without left recursion */
+      FULL,
+      /** rules that are referenced more than once or from within a predicate */
+      STATIC,
+      /** rules whose hit rate in `profile` is at least `minimumHitRate` */
+      ADAPTIVE
+    };
+
+    Mode mode = Mode::FULL;
+    std::shared_ptr<const MemoizationProfile> profile;
+    /** rules that do not appear in the profile are memoized */
+    double minimumHitRate = 0.05;
+
+    static MemoizationPolicy none() { return MemoizationPolicy{Mode::NONE, nullptr}; }
+    static MemoizationPolicy full() { return MemoizationPolicy{Mode::FULL, nullptr}; }
+    static MemoizationPolicy staticAnalysis() { return MemoizationPolicy{Mode::STATIC, nullptr}; }
+    static MemoizationPolicy adaptive(std::shared_ptr<const MemoizationProfile> profile,
+                                      double minimumHitRate = 0.05) {
+      return MemoizationPolicy{Mode::ADAPTIVE, std::move(profile), minimumHitRate};
+    }
+
+    bool operator==(const MemoizationPolicy &other) const {
+      return mode == other.mode && profile == other.profile
+             && minimumHitRate == other.minimumHitRate;
+    }
+    bool operator!=(const MemoizationPolicy &other) const { return !(*this == other); }
+  };
+
+}  // namespace peg_parser
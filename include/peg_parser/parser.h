@@ -1,12 +1,19 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
 #include <stdexcept>
 
+#include "bytecode.h"
 #include "grammar.h"
+#include "memoization.h"
+#include "thread_pool.h"
 
 namespace peg_parser {
 
   struct SyntaxTree {
+    /** does not own the rule in trees created by a `FrozenParser`, see there */
     std::shared_ptr<grammar::Rule> rule;
     std::string_view fullString;
     std::vector<std::shared_ptr<SyntaxTree>> inner;
@@ -17,40 +24,360 @@ namespace peg_parser {
     bool recursive = false;
 
     SyntaxTree(const std::shared_ptr<grammar::Rule> &r, std::string_view s, size_t p);
+    ~SyntaxTree();
 
     size_t length() const { return end - begin; }
     std::string_view view() const { return fullString.substr(begin, length()); }
     std::string string() const { return std::string(view()); }
   };
 
+  /**
+   * A syntax tree stored in flat arrays. Node 0 is the root and the children of every node are
+   * stored contiguously, in order, starting at `firstChild`. Positions take 32 bits if the input
+   * is small enough. Needs a fraction of the memory of the equivalent `SyntaxTree`.
+   */
+  class CompactSyntaxTree {
+  public:
+    using Index = std::uint32_t;
+
+    std::string_view fullString;
+    bool valid = false;
+
+    /** the distinct rules of the tree, referenced by `rule` */
+    std::vector<std::shared_ptr<grammar::Rule>> rules;
+    std::vector<Index> rule;
+    std::vector<Index> firstChild;
+    std::vector<Index> childCount;
+
+  private:
+    std::vector<std::uint32_t> narrowPositions;
+    std::vector<size_t> widePositions;
+
+  public:
+    CompactSyntaxTree() = default;
+    explicit CompactSyntaxTree(const SyntaxTree &tree);
+
+    size_t size() const { return rule.size(); }
+    size_t begin(Index node) const {
+      return widePositions.empty() ? narrowPositions[2 * node] : widePositions[2 * node];
+    }
+    size_t end(Index node) const {
+      return widePositions.empty() ? narrowPositions[2 * node + 1] : widePositions[2 * node + 1];
+    }
+    size_t length(Index node) const { return end(node) - begin(node); }
+    std::string_view view(Index node) const {
+      return fullString.substr(begin(node), length(node));
+    }
+    const std::shared_ptr<grammar::Rule> &getRule(Index node) const { return rules[rule[node]]; }
+    Index child(Index node, size_t idx) const { return firstChild[node] + Index(idx); }
+  };
+
+  /** the input and memo table retained by `Parser::parseIncremental` */
+  struct IncrementalState;
+
+  class FrozenParser;
+  class ParseContext;
+
+  /**
+   * Parsing is thread-safe: any number of threads may call the const methods of the same parser
+   * concurrently, provided that filters can be called concurrently and neither the parser nor its
+   * rules are modified at the same time. The grammar is compiled on first use, concurrent
+   * callers may compile it redundantly. Parsing is not contention-free though: every parse
+   * atomically loads the shared program, which updates its reference count, and compares it
+   * with all rules to detect modifications. Hot concurrent paths should parse with a
+   * `FrozenParser` instead, which avoids shared writes entirely.
+   */
   struct Parser {
     struct Result {
       std::shared_ptr<SyntaxTree> syntax;
+      /**
+       * The visible rule invocation that has read furthest into the input before failing,
+       * without children and ending at the furthest position it has reached, or `syntax` if no
+       * such invocation has failed. See `diagnose` for the expected terminals.
+       */
       std::shared_ptr<SyntaxTree> error;
+      /** only set by `parseIncremental` and `reparse` */
+      std::shared_ptr<IncrementalState> incremental;
+      /** the compiled grammar that has produced the trees, resolves their labels */
+      std::shared_ptr<const bytecode::Program> program;
+    };
+
+    /** replaces `deleted` characters at `offset` by `inserted` */
+    struct Edit {
+      size_t offset;
+      size_t deleted;
+      std::string_view inserted;
+    };
+
+    /** where and why an input has been rejected, see `diagnose` */
+    struct Diagnosis {
+      /** the furthest position at which a terminal or a rule has failed */
+      size_t position = 0;
+      /** the visible rules that have been invoked at `position` and failed */
+      std::vector<std::shared_ptr<grammar::Rule>> rules;
+      /** the terminals that have failed at `position`, e.g. `'+'` or `[0-9]` */
+      std::vector<std::string> terminals;
     };
 
     struct GrammarError : std::exception {
-      enum Type { UNKNOWN_SYMBOL, INVALID_RULE } type;
+      enum Type { UNKNOWN_SYMBOL, INVALID_RULE, INVALID_LABEL, INVALID_CUT } type;
       grammar::Node::Shared node;
       mutable std::string buffer;
       GrammarError(Type t, grammar::Node::Shared n) : type(t), node(n) {}
       const char *what() const noexcept override;
     };
 
+    /**
+     * A rule whose invocations do not depend on the preceding input, such as the records of a
+     * file or the elements of a top-level array, see `parseParallel`.
+     */
+    struct Synchronization {
+      std::shared_ptr<grammar::Rule> rule;
+      /** the first position at or after `position` where `rule` may start, any if unset */
+      std::function<size_t(std::string_view input, size_t position)> findCandidate;
+      /** the minimum length of the chunks parsed in parallel */
+      size_t chunkSize = size_t(1) << 20;
+    };
+
     std::shared_ptr<grammar::Rule> grammar;
+    MemoizationPolicy memoization;
+    Synchronization synchronization;
 
     Parser(const std::shared_ptr<grammar::Rule> &grammar
            = std::make_shared<grammar::Rule>("undefined", grammar::Node::Error()));
 
     static Result parseAndGetError(const std::string_view &str,
                                    std::shared_ptr<grammar::Rule> grammar);
+    static Result parseAndGetError(const std::string_view &str, const bytecode::Program &program);
     static std::shared_ptr<SyntaxTree> parse(const std::string_view &str,
                                              std::shared_ptr<grammar::Rule> grammar);
 
     std::shared_ptr<SyntaxTree> parse(const std::string_view &str) const;
     Result parseAndGetError(const std::string_view &str) const;
+
+    /** parses `str` reusing the memory of `context` */
+    std::shared_ptr<SyntaxTree> parse(const std::string_view &str, ParseContext &context) const;
+    Result parseAndGetError(const std::string_view &str, ParseContext &context) const;
+
+    /**
+     * Replaces the syntax trees of visible rule invocations by values while parsing, see
+     * `parseAndReduce`. Implementations keep a stack holding one value for every child of the
+     * active invocations, in order.
+     */
+    class Reducer {
+    public:
+      /** the compiled grammar parsing into the reducer, set before the parse starts */
+      const bytecode::Program *program = nullptr;
+
+      virtual ~Reducer() = default;
+      /**
+       * Replaces the last `count` values, the children of an invocation of `rule` from `begin`
+       * to `end`, by the value of the invocation.
+       */
+      virtual void reduce(const std::shared_ptr<grammar::Rule> &rule, size_t begin, size_t end,
+                          size_t count)
+          = 0;
+      /** discards all values but the first `size`, as the parser has backtracked */
+      virtual void truncate(size_t size) = 0;
+      /**
+       * Marks the last value as the one of the memoized invocation `tree`. It has to be kept in a
+       * side table once it leaves the stack, as memoized invocations are not reduced again.
+       */
+      virtual void memoize(const SyntaxTree &tree) = 0;
+      /** pushes the value marked by `memoize` for `tree` again */
+      virtual void recall(const SyntaxTree &tree) = 0;
+    };
+
+    /**
+     * Parses `str` and passes every successful invocation of a visible rule to `reducer` as soon
+     * as it is complete, children before their parents. Only memoized and left-recursive
+     * invocations and the start rule's invocation are given a syntax tree, which has no children.
+     * Invocations can still be discarded by backtracking afterwards, memoized ones are reused
+     * without being reduced again. Filters receive trees without children.
+     */
+    Result parseAndReduce(const std::string_view &str, Reducer &reducer) const;
+    Result parseAndReduce(const std::string_view &str, ParseContext &context,
+                          Reducer &reducer) const;
+
+    /**
+     * Parses `str` allocating all syntax trees in a monotonic arena that is released at once
+     * when the returned trees are no longer referenced. Memory is requested from `upstream`,
+     * the child lists are allocated as usual and released when the arena is destroyed. Trees
+     * reached through `inner` do not own the arena and must not outlive the result.
+     */
+    Result parseInArena(const std::string_view &str,
+                        std::pmr::memory_resource *upstream
+                        = std::pmr::get_default_resource()) const;
+
+    /**
+     * Parses the file at `path` without copying it: the file is memory-mapped read-only where
+     * supported and read into memory otherwise. The mapping is released when the returned trees
+     * are no longer referenced, trees reached through `inner` must not outlive the result.
+     */
+    Result parseFile(const std::string &path) const;
+
+    /**
+     * Parses a copy of `str` and retains it in the result together with the memo table, which
+     * records how far each rule invocation has read the input. The result can then be updated
+     * by `reparse`.
+     */
+    Result parseIncremental(const std::string_view &str) const;
+
+    /**
+     * Applies `edit` to the input of `previous`, a result of `parseIncremental` or `reparse`,
+     * and parses it again. Memoized results that have not read the edited range are reused and
+     * moved, so only the affected region is parsed. `previous` is consumed and left empty: its
+     * trees are reused or invalidated, including copies of its `syntax` and `error` pointers, and
+     * must not be used afterwards. It is left unchanged if the edit is rejected.
+     */
+    Result reparse(Result &&previous, const Edit &edit) const;
+
+    /** receives the result of the input at `index` of a batch */
+    using BatchCallback = std::function<void(size_t index, Result &result)>;
+
+    /**
+     * Parses all `inputs` on the workers of `pool` and returns the results in input order. Each
+     * worker reuses its memo table for the inputs it parses. The parser must not be modified
+     * during the batch.
+     */
+    std::vector<Result> parseBatch(const std::vector<std::string_view> &inputs,
+                                   ThreadPool &pool = ThreadPool::shared()) const;
+
+    /** parses all `inputs` like above, passing each result to `process` on its worker thread */
+    void parseBatch(const std::vector<std::string_view> &inputs, const BatchCallback &process,
+                    ThreadPool &pool = ThreadPool::shared()) const;
+
+    /**
+     * Parses `str` on the workers of `pool` with the same result as `parseAndGetError`. Every
+     * worker speculatively parses the invocations of the synchronization rule in a chunk of the
+     * input, starting at its first candidate position. A sequential parse then finds these
+     * invocations in the memo table and only parses the input between them, as well as chunks
+     * whose speculative start has not been aligned with an actual invocation. Falls back to a
+     * sequential parse if the input is shorter than two chunks or the synchronization rule is
+     * unset or not memoized. Filters must be safe to call concurrently.
+     */
+    Result parseParallel(const std::string_view &str,
+                         ThreadPool &pool = ThreadPool::shared()) const;
+
+    /**
+     * Parses `str` again, recording the furthest failures, to explain why it has been rejected.
+     * Parsing itself only tracks the furthest failed rule invocation in `Result::error`, so this
+     * should only be called for rejected inputs.
+     */
+    Diagnosis diagnose(const std::string_view &str) const;
+
+    /** parses `str` and returns the result as a `CompactSyntaxTree` */
+    CompactSyntaxTree parseCompact(const std::string_view &str) const;
+
+    /**
+     * Parses `str` memoizing all rules and adds the number of invocations and memo table hits
+     * of each rule to `profile`, independent of the memoization policy.
+     */
+    Result parseAndProfile(const std::string_view &str, MemoizationProfile &profile) const;
+
+    /**
+     * The compiled grammar, recompiled whenever the rules or the policy have been modified.
+     * Detecting modifications visits every node of the compiled rules.
+     */
+    std::shared_ptr<const bytecode::Program> getProgram() const;
+
+    /** a snapshot of the current grammar for concurrent parsing */
+    FrozenParser freeze() const;
+
+  private:
+    mutable std::shared_ptr<const bytecode::Program> program;
+  };
+
+  /**
+   * An immutable compiled grammar, unaffected by later modifications of the parser it has been
+   * created from. Parsing only reads the shared program and creates syntax trees that refer to
+   * its rules without reference counting, so concurrent parses do not write to any shared memory.
+   * The `rule` of these trees is a non-owning pointer: the rules are kept alive only by the
+   * frozen parser and its copies, which must therefore outlive all syntax trees it has created,
+   * including subtrees kept after their root. `rule.use_count()` is 0 for such trees, callers that
+   * need trees outliving the parser should use a regular `Parser`.
+   */
+  class FrozenParser {
+  public:
+    explicit FrozenParser(const Parser &parser);
+
+    std::shared_ptr<SyntaxTree> parse(const std::string_view &str) const;
+    Parser::Result parseAndGetError(const std::string_view &str) const;
+
+    /** parses `str` reusing the memory of `context` */
+    std::shared_ptr<SyntaxTree> parse(const std::string_view &str, ParseContext &context) const;
+    Parser::Result parseAndGetError(const std::string_view &str, ParseContext &context) const;
+
+    const bytecode::Program &getProgram() const { return *program; }
+
+  private:
+    std::shared_ptr<const bytecode::Program> program;
+  };
+
+  /**
+   * Memory reused by consecutive parses: the memo table and the stacks of the parsing machine are
+   * cleared between parses but keep their capacity. A context can be passed to any parser, but
+   * only to one parse at a time, typically by keeping one context per thread. The memo table
+   * refers to the trees of the most recent parse until the next one starts.
+   */
+  class ParseContext {
+  public:
+    ParseContext();
+    ParseContext(ParseContext &&);
+    ParseContext &operator=(ParseContext &&);
+    ~ParseContext();
+
+  private:
+    friend struct Parser;
+    friend class FrozenParser;
+    struct Implementation;
+    std::unique_ptr<Implementation> implementation;
+  };
+
+  /**
+   * Parses input that arrives in chunks. Every chunk advances the parser as far as the input
+   * received so far allows, it then suspends and resumes at the same point once the next chunk
+   * arrives, without parsing the prefix again.
+   *
+   * Children of the start rule that no remaining alternative can discard are passed to the item
+   * callback as soon as possible. A cut marks such a point in the grammar, e.g. every `Record`
+   * of `Records <- Record*` is emitted once the next one reaches the cut of
+   * `Record <- Key ^ '=' Value ';'`. Input that precedes all emitted items and positions the
+   * parser may return to is released. Emitted trees refer to the buffered input and are only
+   * valid during the callback, their positions are relative to `getOffset()`.
+   */
+  class PushParser {
+  public:
+    using ItemCallback = std::function<void(const std::shared_ptr<SyntaxTree> &)>;
+
+    enum class Status {
+      NEEDS_INPUT,
+      /** the start rule has been matched without reaching the end of the input */
+      COMPLETE
+    };
+
+    explicit PushParser(const Parser &parser, ItemCallback onItem = ItemCallback());
+    ~PushParser();
+
+    /** appends `chunk` to the input and continues parsing, ignored once complete */
+    Status feed(std::string_view chunk);
+
+    /**
+     * Marks the end of the input and returns the result. With an item callback, the remaining
+     * children of a valid start rule are emitted as well and the returned tree has no children.
+     * The parser cannot be used afterwards.
+     */
+    Parser::Result finish();
+
+    /** the position of the first buffered character in the complete input */
+    size_t getOffset() const;
+
+  private:
+    struct Implementation;
+    std::unique_ptr<Implementation> implementation;
   };
 
   std::ostream &operator<<(std::ostream &stream, const SyntaxTree &tree);
+  std::ostream &operator<<(std::ostream &stream, const CompactSyntaxTree &tree);
 
 }  // namespace peg_parser
@@ -0,0 +1,761 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "grammar.h"
+#include "parser.h"
+
+namespace peg_parser {
+
+  /**
+   * Grammars that are compiled to a parser by the C++ compiler. `compile` parses the grammar
+   * language of `ParserGenerator` in a constant expression and `match` or `parse` instantiate a
+   * function for every node of the result, so the parser has no heap allocated grammar and no
+   * dispatch on node types. Syntax errors in the grammar are compile-time errors.
+   */
+  namespace static_grammar {
+
+    enum class Symbol : std::uint8_t {
+      WORD,
+      ANY,
+      SET,
+      SEQUENCE,
+      CHOICE,
+      ZERO_OR_MORE,
+      ONE_OR_MORE,
+      OPTIONAL,
+      ALSO,
+      NOT,
+      EMPTY,
+      ERROR,
+      END_OF_FILE,
+      RULE,
+      CAPTURE
+    };
+
+    struct Node {
+      Symbol symbol = Symbol::EMPTY;
+      /** the first entry in `children`, the only child, the character set or the rule */
+      size_t index = 0;
+      /** the number of children */
+      size_t size = 0;
+      /** the letters of a word, a label or the name of a referenced rule */
+      size_t text = 0;
+      size_t textSize = 0;
+    };
+
+    struct CharacterSet {
+      std::array<std::uint64_t, 4> bits{};
+
+      constexpr void add(unsigned char c) { bits[c / 64] |= std::uint64_t(1) << (c % 64); }
+      constexpr bool contains(unsigned char c) const {
+        return (bits[c / 64] >> (c % 64)) & 1;
+      }
+    };
+
+    struct Rule {
+      size_t name = 0;
+      size_t nameSize = 0;
+      size_t node = 0;
+    };
+
+    /** a grammar compiled from a source of `N` characters, sized for the worst case */
+    template <size_t N> struct Grammar {
+      std::array<Node, N + 1> nodes{};
+      std::array<size_t, N + 1> children{};
+      std::array<CharacterSet, N / 2 + 1> sets{};
+      std::array<char, N + 1> letters{};
+      std::array<Rule, N / 4 + 1> rules{};
+      size_t nodeCount = 0, childCount = 0, setCount = 0, letterCount = 0, ruleCount = 0;
+
+      constexpr std::string_view text(size_t begin, size_t size) const {
+        return std::string_view(letters.data() + begin, size);
+      }
+      constexpr std::string_view name(size_t rule) const {
+        return text(rules[rule].name, rules[rule].nameSize);
+      }
+    };
+
+    namespace detail {
+
+      template <size_t N> class Compiler {
+      public:
+        Grammar<N> grammar;
+
+        constexpr explicit Compiler(std::string_view s) : source(s) {}
+
+        constexpr void compile() {
+          skipLines();
+          auto start = position;
+          if (!parseDefinitionHead()) {
+            position = start;
+            addRule(addLetters("Start"), 5, parseChoice());
+            skipLines();
+          } else {
+            position = start;
+            while (position < source.size()) {
+              parseDefinitionHead();
+              auto name = grammar.letterCount - lastNameSize;
+              addRule(name, lastNameSize, parseChoice());
+              if (position < source.size() && !isNewline(peek())) {
+                break;
+              }
+              skipLines();
+            }
+          }
+          if (position < source.size()) {
+            throw std::invalid_argument("syntax error in static grammar");
+          }
+          resolveRules();
+          checkLeftRecursion();
+        }
+
+      private:
+        std::string_view source;
+        size_t position = 0;
+        size_t lastNameSize = 0;
+        /**
+         * The following element of the list each node has been parsed into, so that nested lists
+         * share one array instead of reserving space for `N` elements on every level.
+         */
+        std::array<size_t, N + 1> next{};
+
+        static constexpr bool isNewline(char c) { return c == '\n' || c == '\r'; }
+        static constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+        static constexpr bool isNameCharacter(char c) {
+          return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || isDigit(c) || c == '_';
+        }
+        static constexpr int hexValue(char c) {
+          if (isDigit(c)) {
+            return c - '0';
+          }
+          if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+          }
+          if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+          }
+          return -1;
+        }
+
+        constexpr char peek(size_t offset = 0) const {
+          return position + offset < source.size() ? source[position + offset] : '\0';
+        }
+        constexpr bool consume(std::string_view word) {
+          if (source.substr(position, word.size()) == word) {
+            position += word.size();
+            return true;
+          }
+          return false;
+        }
+        constexpr void expect(std::string_view word) {
+          if (!consume(word)) {
+            throw std::invalid_argument("syntax error in static grammar");
+          }
+        }
+        constexpr void skipWhitespace() {
+          while (peek() == ' ' || peek() == '\t') {
+            ++position;
+          }
+        }
+        constexpr void skipLines() {
+          while (position < source.size()
+                 && (peek() == ' ' || peek() == '\t' || isNewline(peek()))) {
+            ++position;
+          }
+        }
+
+        constexpr size_t addLetters(std::string_view text) {
+          auto begin = grammar.letterCount;
+          for (auto c : text) {
+            grammar.letters[grammar.letterCount++] = c;
+          }
+          return begin;
+        }
+        constexpr size_t addNode(Node node) {
+          grammar.nodes[grammar.nodeCount] = node;
+          return grammar.nodeCount++;
+        }
+        constexpr void addRule(size_t name, size_t nameSize, size_t node) {
+          for (size_t i = 0; i < grammar.ruleCount; ++i) {
+            if (grammar.name(i) == grammar.text(name, nameSize)) {
+              throw std::invalid_argument("rule defined twice in static grammar");
+            }
+          }
+          grammar.rules[grammar.ruleCount++] = Rule{name, nameSize, node};
+        }
+
+        /** parses a rule name into `letters`, returns its size */
+        constexpr size_t parseName() {
+          if (isDigit(peek()) || !isNameCharacter(peek())) {
+            return 0;
+          }
+          auto begin = position;
+          while (isNameCharacter(peek())) {
+            ++position;
+          }
+          addLetters(source.substr(begin, position - begin));
+          return position - begin;
+        }
+
+        constexpr bool parseDefinitionHead() {
+          skipWhitespace();
+          auto letters = grammar.letterCount;
+          lastNameSize = parseName();
+          skipWhitespace();
+          if (lastNameSize == 0 || !consume("<-")) {
+            grammar.letterCount = letters;
+            return false;
+          }
+          return true;
+        }
+
+        /** the node of the `size` nodes linked by `next` from `first` */
+        constexpr size_t addList(Symbol symbol, size_t first, size_t size) {
+          if (size == 1) {
+            return first;
+          }
+          auto begin = grammar.childCount;
+          for (auto node = first; grammar.childCount < begin + size; node = next[node]) {
+            grammar.children[grammar.childCount++] = node;
+          }
+          return addNode(Node{symbol, begin, size, 0, 0});
+        }
+
+        constexpr size_t parseChoice() {
+          auto first = parseSequence(), last = first;
+          size_t size = 1;
+          while (consume("|")) {
+            last = next[last] = parseSequence();
+            ++size;
+          }
+          return addList(Symbol::CHOICE, first, size);
+        }
+
+        constexpr size_t parseSequence() {
+          size_t first = 0, last = 0, size = 0;
+          while (true) {
+            skipWhitespace();
+            auto c = peek();
+            if (c == '\0' || c == '|' || c == ')' || isNewline(c)) {
+              break;
+            }
+            auto element = parseElement();
+            if (size++ == 0) {
+              first = element;
+            } else {
+              next[last] = element;
+            }
+            last = element;
+          }
+          if (size == 0) {
+            throw std::invalid_argument("empty sequence in static grammar");
+          }
+          return addList(Symbol::SEQUENCE, first, size);
+        }
+
+        constexpr size_t parseElement() {
+          auto start = position;
+          auto letters = grammar.letterCount;
+          if (auto size = parseName(); size > 0 && consume(":")) {
+            auto inner = parseUnary();
+            return addNode(Node{Symbol::CAPTURE, inner, 1, letters, size});
+          }
+          position = start;
+          grammar.letterCount = letters;
+          return parseUnary();
+        }
+
+        constexpr size_t parseUnary() {
+          auto inner = parseAtomic();
+          skipWhitespace();
+          if (consume("*")) {
+            return addNode(Node{Symbol::ZERO_OR_MORE, inner, 1, 0, 0});
+          }
+          if (consume("+")) {
+            return addNode(Node{Symbol::ONE_OR_MORE, inner, 1, 0, 0});
+          }
+          if (consume("?")) {
+            return addNode(Node{Symbol::OPTIONAL, inner, 1, 0, 0});
+          }
+          return inner;
+        }
+
+        constexpr size_t parseAtomic() {
+          skipWhitespace();
+          if (consume("&")) {
+            return addNode(Node{Symbol::ALSO, parseAtomic(), 1, 0, 0});
+          }
+          if (consume("!")) {
+            return addNode(Node{Symbol::NOT, parseAtomic(), 1, 0, 0});
+          }
+          if (consume("'")) {
+            auto begin = grammar.letterCount;
+            while (!consume("'")) {
+              if (position >= source.size()) {
+                throw std::invalid_argument("unterminated word in static grammar");
+              }
+              grammar.letters[grammar.letterCount++] = parseCharacter();
+            }
+            auto size = grammar.letterCount - begin;
+            return addNode(Node{size == 0 ? Symbol::EMPTY : Symbol::WORD, 0, 0, begin, size});
+          }
+          if (consume("(")) {
+            auto inner = parseChoice();
+            skipWhitespace();
+            expect(")");
+            return inner;
+          }
+          if (consume("<EOF>")) {
+            return addNode(Node{Symbol::END_OF_FILE, 0, 0, 0, 0});
+          }
+          if (consume(".")) {
+            return addNode(Node{Symbol::ANY, 0, 0, 0, 0});
+          }
+          if (consume("[")) {
+            return parseSelect();
+          }
+          auto letters = grammar.letterCount;
+          if (auto size = parseName()) {
+            return addNode(Node{Symbol::RULE, 0, 0, letters, size});
+          }
+          throw std::invalid_argument("syntax error in static grammar");
+        }
+
+        constexpr size_t parseSelect() {
+          CharacterSet set;
+          size_t count = 0;
+          while (!consume("]")) {
+            if (position >= source.size() || peek() == '-') {
+              throw std::invalid_argument("invalid character selection in static grammar");
+            }
+            auto first = static_cast<unsigned char>(parseCharacter());
+            auto last = first;
+            if (consume("-")) {
+              last = static_cast<unsigned char>(parseCharacter());
+            }
+            for (unsigned c = first; c <= last; ++c) {
+              set.add(static_cast<unsigned char>(c));
+            }
+            ++count;
+          }
+          if (count == 0) {
+            return addNode(Node{Symbol::ERROR, 0, 0, 0, 0});
+          }
+          grammar.sets[grammar.setCount] = set;
+          return addNode(Node{Symbol::SET, grammar.setCount++, 0, 0, 0});
+        }
+
+        /** a character of a word or selection, with the escape codes of the runtime grammar */
+        constexpr char parseCharacter() {
+          if (!consume("\\")) {
+            return source[position++];
+          }
+          if (hexValue(peek()) >= 0) {
+            int code = 0;
+            while (hexValue(peek()) >= 0) {
+              code = code * 16 + hexValue(source[position++]);
+            }
+            return char(code);
+          }
+          if (position >= source.size()) {
+            throw std::invalid_argument("unterminated escape code in static grammar");
+          }
+          auto c = source[position++];
+          return c == 'n' ? '\n' : c == 't' ? '\t' : c;
+        }
+
+        constexpr void resolveRules() {
+          for (size_t i = 0; i < grammar.nodeCount; ++i) {
+            auto &node = grammar.nodes[i];
+            if (node.symbol != Symbol::RULE) {
+              continue;
+            }
+            auto name = grammar.text(node.text, node.textSize);
+            node.index = grammar.ruleCount;
+            for (size_t rule = 0; rule < grammar.ruleCount; ++rule) {
+              if (grammar.name(rule) == name) {
+                node.index = rule;
+              }
+            }
+            if (node.index == grammar.ruleCount) {
+              throw std::invalid_argument("undefined rule in static grammar");
+            }
+          }
+        }
+
+        constexpr bool nullable(size_t index, const std::array<bool, N / 4 + 1> &rules) const {
+          auto &node = grammar.nodes[index];
+          switch (node.symbol) {
+            case Symbol::WORD:
+            case Symbol::ANY:
+            case Symbol::SET:
+            case Symbol::ERROR:
+              return false;
+            case Symbol::SEQUENCE:
+              for (size_t i = 0; i < node.size; ++i) {
+                if (!nullable(grammar.children[node.index + i], rules)) {
+                  return false;
+                }
+              }
+              return true;
+            case Symbol::CHOICE:
+              for (size_t i = 0; i < node.size; ++i) {
+                if (nullable(grammar.children[node.index + i], rules)) {
+                  return true;
+                }
+              }
+              return false;
+            case Symbol::ONE_OR_MORE:
+            case Symbol::CAPTURE:
+              return nullable(node.index, rules);
+            case Symbol::RULE:
+              return rules[node.index];
+            default:
+              return true;
+          }
+        }
+
+        /** marks the rules `node` may call before consuming input */
+        constexpr void addLeftCalls(size_t index, const std::array<bool, N / 4 + 1> &nullableRules,
+                                    std::array<bool, N / 4 + 1> &called) const {
+          auto &node = grammar.nodes[index];
+          switch (node.symbol) {
+            case Symbol::SEQUENCE:
+              for (size_t i = 0; i < node.size; ++i) {
+                auto child = grammar.children[node.index + i];
+                addLeftCalls(child, nullableRules, called);
+                if (!nullable(child, nullableRules)) {
+                  return;
+                }
+              }
+              return;
+            case Symbol::CHOICE:
+              for (size_t i = 0; i < node.size; ++i) {
+                addLeftCalls(grammar.children[node.index + i], nullableRules, called);
+              }
+              return;
+            case Symbol::ZERO_OR_MORE:
+            case Symbol::ONE_OR_MORE:
+            case Symbol::OPTIONAL:
+            case Symbol::ALSO:
+            case Symbol::NOT:
+            case Symbol::CAPTURE:
+              addLeftCalls(node.index, nullableRules, called);
+              return;
+            case Symbol::RULE:
+              called[node.index] = true;
+              return;
+            default:
+              return;
+          }
+        }
+
+        /** rules are parsed by recursive functions, which cannot handle left recursion */
+        constexpr void checkLeftRecursion() const {
+          std::array<bool, N / 4 + 1> nullableRules{};
+          for (bool changed = true; changed;) {
+            changed = false;
+            for (size_t rule = 0; rule < grammar.ruleCount; ++rule) {
+              if (!nullableRules[rule] && nullable(grammar.rules[rule].node, nullableRules)) {
+                nullableRules[rule] = true;
+                changed = true;
+              }
+            }
+          }
+          for (size_t rule = 0; rule < grammar.ruleCount; ++rule) {
+            std::array<bool, N / 4 + 1> reached{};
+            addLeftCalls(grammar.rules[rule].node, nullableRules, reached);
+            for (bool changed = true; changed;) {
+              changed = false;
+              for (size_t other = 0; other < grammar.ruleCount; ++other) {
+                std::array<bool, N / 4 + 1> called{};
+                if (reached[other]) {
+                  addLeftCalls(grammar.rules[other].node, nullableRules, called);
+                }
+                for (size_t i = 0; i < grammar.ruleCount; ++i) {
+                  if (called[i] && !reached[i]) {
+                    reached[i] = changed = true;
+                  }
+                }
+              }
+            }
+            if (reached[rule]) {
+              throw std::invalid_argument("left-recursive rule in static grammar");
+            }
+          }
+        }
+      };
+
+      /** the builder of `match`, which only recognizes the input */
+      struct Recognizer {
+        constexpr size_t mark() const { return 0; }
+        constexpr void reset(size_t) const {}
+        constexpr void addRule(size_t, size_t, size_t, size_t) const {}
+      };
+
+      /** the builder of `parse`, which collects the syntax trees of matched rules */
+      struct TreeBuilder {
+        const std::vector<std::shared_ptr<grammar::Rule>> &rules;
+        std::string_view input;
+        std::vector<std::shared_ptr<SyntaxTree>> inner;
+
+        size_t mark() const { return inner.size(); }
+        void reset(size_t mark) { inner.resize(mark); }
+        void addRule(size_t rule, size_t begin, size_t end, size_t mark) {
+          auto tree = std::make_shared<SyntaxTree>(rules[rule], input, begin);
+          tree->inner.assign(std::make_move_iterator(inner.begin() + mark),
+                             std::make_move_iterator(inner.end()));
+          inner.resize(mark);
+          tree->end = end;
+          tree->valid = true;
+          tree->active = false;
+          inner.push_back(std::move(tree));
+        }
+      };
+
+      template <const auto &G, class Builder> struct Matcher {
+        template <size_t I>
+        static constexpr bool match(std::string_view input, size_t &position, Builder &builder) {
+          constexpr Node node = G.nodes[I];
+
+          if constexpr (node.symbol == Symbol::WORD) {
+            constexpr auto word = G.text(node.text, node.textSize);
+            if (input.substr(position, word.size()) != word) {
+              return false;
+            }
+            position += word.size();
+            return true;
+          } else if constexpr (node.symbol == Symbol::ANY) {
+            return position < input.size() && (++position, true);
+          } else if constexpr (node.symbol == Symbol::SET) {
+            if (position < input.size()
+                && G.sets[node.index].contains(static_cast<unsigned char>(input[position]))) {
+              ++position;
+              return true;
+            }
+            return false;
+          } else if constexpr (node.symbol == Symbol::SEQUENCE) {
+            return sequence<I>(input, position, builder, std::make_index_sequence<node.size>());
+          } else if constexpr (node.symbol == Symbol::CHOICE) {
+            return choice<I>(input, position, builder, std::make_index_sequence<node.size>());
+          } else if constexpr (node.symbol == Symbol::ZERO_OR_MORE
+                               || node.symbol == Symbol::ONE_OR_MORE) {
+            if constexpr (node.symbol == Symbol::ONE_OR_MORE) {
+              if (!match<node.index>(input, position, builder)) {
+                return false;
+              }
+            }
+            while (true) {
+              auto start = position;
+              auto mark = builder.mark();
+              if (!match<node.index>(input, position, builder) || position == start) {
+                position = start;
+                builder.reset(mark);
+                return true;
+              }
+            }
+          } else if constexpr (node.symbol == Symbol::OPTIONAL) {
+            attempt<node.index>(input, position, builder);
+            return true;
+          } else if constexpr (node.symbol == Symbol::ALSO || node.symbol == Symbol::NOT) {
+            auto start = position;
+            auto mark = builder.mark();
+            auto matched = match<node.index>(input, position, builder);
+            position = start;
+            builder.reset(mark);
+            return matched == (node.symbol == Symbol::ALSO);
+          } else if constexpr (node.symbol == Symbol::EMPTY) {
+            return true;
+          } else if constexpr (node.symbol == Symbol::ERROR) {
+            return false;
+          } else if constexpr (node.symbol == Symbol::END_OF_FILE) {
+            return position == input.size();
+          } else if constexpr (node.symbol == Symbol::RULE) {
+            return rule<node.index>(input, position, builder);
+          } else if constexpr (node.symbol == Symbol::CAPTURE) {
+            // labels only affect the evaluation of the tree
+            return match<node.index>(input, position, builder);
+          }
+        }
+
+        template <size_t R>
+        static constexpr bool rule(std::string_view input, size_t &position, Builder &builder) {
+          auto begin = position;
+          auto mark = builder.mark();
+          if (!match<G.rules[R].node>(input, position, builder)) {
+            return false;
+          }
+          builder.addRule(R, begin, position, mark);
+          return true;
+        }
+
+      private:
+        /** matches `I`, restoring the state if it fails */
+        template <size_t I>
+        static constexpr bool attempt(std::string_view input, size_t &position, Builder &builder) {
+          auto start = position;
+          auto mark = builder.mark();
+          if (match<I>(input, position, builder)) {
+            return true;
+          }
+          position = start;
+          builder.reset(mark);
+          return false;
+        }
+
+        template <size_t I, size_t... J>
+        static constexpr bool sequence(std::string_view input, size_t &position, Builder &builder,
+                                       std::index_sequence<J...>) {
+          return (match<G.children[G.nodes[I].index + J]>(input, position, builder) && ...);
+        }
+
+        template <size_t I, size_t... J>
+        static constexpr bool choice(std::string_view input, size_t &position, Builder &builder,
+                                     std::index_sequence<J...>) {
+          return (attempt<G.children[G.nodes[I].index + J]>(input, position, builder) || ...);
+        }
+      };
+
+      template <const auto &G> grammar::Node::Shared makeNode(
+          size_t index, const std::vector<std::shared_ptr<grammar::Rule>> &rules) {
+        using GN = grammar::Node;
+        auto &node = G.nodes[index];
+        auto child = [&](size_t i) { return makeNode<G>(G.children[node.index + i], rules); };
+        switch (node.symbol) {
+          case Symbol::WORD:
+            return GN::Word(std::string(G.text(node.text, node.textSize)));
+          case Symbol::ANY:
+            return GN::Any();
+          case Symbol::SET: {
+            // runs of members as ranges, split where `char` changes its sign
+            std::vector<GN::Shared> ranges;
+            auto &set = G.sets[node.index];
+            for (unsigned c = 0; c < 256; ++c) {
+              if (set.contains(static_cast<unsigned char>(c))) {
+                auto first = c;
+                while (c + 1 != 128 && c + 1 < 256
+                       && set.contains(static_cast<unsigned char>(c + 1))) {
+                  ++c;
+                }
+                ranges.push_back(GN::Range(char(first), char(c)));
+              }
+            }
+            return ranges.size() == 1 ? ranges[0] : GN::Choice(ranges);
+          }
+          case Symbol::SEQUENCE:
+          case Symbol::CHOICE: {
+            std::vector<GN::Shared> args;
+            for (size_t i = 0; i < node.size; ++i) {
+              args.push_back(child(i));
+            }
+            return node.symbol == Symbol::SEQUENCE ? GN::Sequence(args) : GN::Choice(args);
+          }
+          case Symbol::ZERO_OR_MORE:
+            return GN::ZeroOrMore(makeNode<G>(node.index, rules));
+          case Symbol::ONE_OR_MORE:
+            return GN::OneOrMore(makeNode<G>(node.index, rules));
+          case Symbol::OPTIONAL:
+            return GN::Optional(makeNode<G>(node.index, rules));
+          case Symbol::ALSO:
+            return GN::Also(makeNode<G>(node.index, rules));
+          case Symbol::NOT:
+            return GN::Not(makeNode<G>(node.index, rules));
+          case Symbol::EMPTY:
+            return GN::Empty();
+          case Symbol::ERROR:
+            return GN::Error();
+          case Symbol::END_OF_FILE:
+            return GN::EndOfFile();
+          case Symbol::RULE:
+            return GN::WeakRule(rules[node.index]);
+          case Symbol::CAPTURE:
+            return GN::Capture(std::string(G.text(node.text, node.textSize)),
+                               makeNode<G>(node.index, rules));
+        }
+        throw std::invalid_argument("corrupted static grammar");
+      }
+
+    }  // namespace detail
+
+    /**
+     * Compiles a grammar in a constant expression. The source is either a single expression,
+     * which becomes the rule `Start`, or one definition `Name <- Expression` per line, the first
+     * being the start rule. Left-recursive rules are rejected, which is a compile-time error when
+     * the result initializes a `constexpr` variable.
+     *
+     * Rules are matched by plain recursive descent without memoization, as required by hot paths
+     * with fixed, unambiguous formats. Grammars whose choices are decided by a bounded lookahead
+     * match in time linear in the input, but backtracking over nested choices can take
+     * exponential time in the worst case, where a `Parser` with memoization stays polynomial.
+     */
+    template <size_t N> constexpr Grammar<N> compile(const char (&source)[N]) {
+      detail::Compiler<N> compiler(std::string_view(source, N - 1));
+      compiler.compile();
+      return compiler.grammar;
+    }
+
+    /** the length of the prefix of `input` matched by the start rule of `G`, if any */
+    template <const auto &G> constexpr std::optional<size_t> match(std::string_view input) {
+      size_t position = 0;
+      detail::Recognizer recognizer;
+      if (detail::Matcher<G, detail::Recognizer>::template rule<0>(input, position, recognizer)) {
+        return position;
+      }
+      return {};
+    }
+
+    /**
+     * Runtime rules equivalent to the rules of `G`, in the order of their definition. They give
+     * the syntax trees of `parse` their rules, can be assigned evaluators and can be referenced
+     * from runtime grammars.
+     */
+    template <const auto &G> const std::vector<std::shared_ptr<grammar::Rule>> &rules() {
+      static const auto rules = []() {
+        std::vector<std::shared_ptr<grammar::Rule>> result;
+        for (size_t rule = 0; rule < G.ruleCount; ++rule) {
+          result.push_back(grammar::makeRule(G.name(rule), grammar::Node::Error()));
+        }
+        for (size_t rule = 0; rule < G.ruleCount; ++rule) {
+          auto node = detail::makeNode<G>(G.rules[rule].node, result);
+          result[rule]->labels = grammar::resolveLabels(node);
+          result[rule]->node = node;
+        }
+        return result;
+      }();
+      return rules;
+    }
+
+    /** the runtime rule called `name`, see `rules` */
+    template <const auto &G> std::shared_ptr<grammar::Rule> getRule(std::string_view name) {
+      for (auto &rule : rules<G>()) {
+        if (rule->name == name) {
+          return rule;
+        }
+      }
+      throw std::invalid_argument("unknown rule " + std::string(name));
+    }
+
+    /**
+     * Parses the start of `input` like `Parser::parse`, the tree refers to `input` and the
+     * runtime rules of `G`. Rules are never hidden, as static grammars have no separators.
+     */
+    template <const auto &G> std::shared_ptr<SyntaxTree> parse(std::string_view input) {
+      detail::TreeBuilder builder{rules<G>(), input, {}};
+      size_t position = 0;
+      if (detail::Matcher<G, detail::TreeBuilder>::template rule<0>(input, position, builder)) {
+        return builder.inner.back();
+      }
+      return std::make_shared<SyntaxTree>(rules<G>()[0], input, 0);
+    }
+
+  }  // namespace static_grammar
+
+}  // namespace peg_parser
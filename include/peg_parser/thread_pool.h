@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+namespace peg_parser {
+
+  /**
+   * A fixed set of worker threads that process batches of indexed tasks. Every worker starts
+   * with a contiguous range of the indices and steals half of the remaining range of another
+   * worker once its own range is exhausted. The thread calling `run` takes part as worker 0.
+   */
+  class ThreadPool {
+  public:
+    using Task = std::function<void(size_t index, size_t worker)>;
+
+    /** creates a pool of `threads` workers including the calling thread, 0 for one per core */
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /** the number of workers, tasks receive a worker index below it */
+    size_t size() const;
+
+    /**
+     * Calls `task` for every index below `count` and returns once all calls have returned.
+     * Concurrent batches are run one after another. If a task throws, the remaining indices are
+     * skipped and the first exception is rethrown. Batches started from within a task run
+     * sequentially on the calling thread as worker 0.
+     */
+    void run(size_t count, const Task &task);
+
+    /** a pool with one worker per core, created on first use */
+    static ThreadPool &shared();
+
+  private:
+    struct Implementation;
+    std::unique_ptr<Implementation> implementation;
+  };
+
+}  // namespace peg_parser
@@ -0,0 +1,903 @@
+#include <easy_iterator.h>
+#include <peg_parser/bytecode.h>
+#include <peg_parser/parser.h>
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+using namespace peg_parser;
+using namespace peg_parser::bytecode;
+
+namespace {
+
+  /**  alternative to `std::get` that works on iOS < 11 */
+  template <class T, class V> const T &pget(const V &v) {
+    if (auto r = std::get_if<T>(&v)) {
+      return *r;
+    } else {
+      throw std::runtime_error("corrupted grammar node");
+    }
+  }
+
+  using Opcode = Instruction::Opcode;
+
+  /**
+   * Calls `visit` for `node` and its descendants in preorder, without following references to
+   * other rules. Stops as soon as `visit` returns false and returns false in that case.
+   */
+  template <class F> bool visitNodes(const grammar::Node::Shared &node, F &&visit) {
+    using Symbol = grammar::Node::Symbol;
+    if (!visit(node)) {
+      return false;
+    }
+    switch (node->symbol) {
+      case Symbol::SEQUENCE:
+      case Symbol::CHOICE: {
+        for (auto &child : pget<std::vector<grammar::Node::Shared>>(node->data)) {
+          if (!visitNodes(child, visit)) {
+            return false;
+          }
+        }
+        return true;
+      }
+      case Symbol::ZERO_OR_MORE:
+      case Symbol::ONE_OR_MORE:
+      case Symbol::OPTIONAL:
+      case Symbol::ALSO:
+      case Symbol::NOT: {
+        return visitNodes(pget<grammar::Node::Shared>(node->data), visit);
+      }
+      case Symbol::CAPTURE: {
+        return visitNodes(
+            pget<std::pair<std::string, grammar::Node::Shared>>(node->data).second, visit);
+      }
+      default:
+        return true;
+    }
+  }
+
+  std::vector<grammar::Node::Shared> collectNodes(const grammar::Node::Shared &node) {
+    std::vector<grammar::Node::Shared> nodes;
+    visitNodes(node, [&](const grammar::Node::Shared &n) {
+      nodes.push_back(n);
+      return true;
+    });
+    return nodes;
+  }
+
+  class Compiler {
+  private:
+    Program &program;
+    std::unordered_map<const grammar::Rule *, std::uint32_t> ruleIndices;
+    std::vector<std::uint32_t> pending;
+    /** the number of backtrack entries held by the constructs enclosing the compiled node */
+    std::uint32_t openEntries = 0;
+    /**
+     * The backtrack entry committed by a cut in each enclosing choice alternative, repetition or
+     * optional node, `NO_CUT_TARGET` where it is committed already and `INVALID_CUT` where there
+     * is nothing to commit.
+     */
+    std::vector<std::uint32_t> cutTargets;
+    static constexpr std::uint32_t INVALID_CUT = Instruction::NO_CUT_TARGET - 1;
+    /** the grammar of the rule being compiled, reported by errors */
+    grammar::Node::Shared ruleNode;
+
+    std::uint32_t position() const { return std::uint32_t(program.instructions.size()); }
+
+    std::uint32_t emit(Opcode opcode, std::uint32_t argument = 0) {
+      program.instructions.emplace_back(opcode, argument);
+      return position() - 1;
+    }
+
+    void setTarget(std::uint32_t instruction, std::uint32_t target) {
+      program.instructions[instruction].argument = target;
+    }
+
+    std::uint32_t getRuleIndex(const std::shared_ptr<grammar::Rule> &rule) {
+      auto it = ruleIndices.find(rule.get());
+      if (it != ruleIndices.end()) {
+        return it->second;
+      }
+      auto index = std::uint32_t(program.rules.size());
+      program.rules.push_back(Program::RuleEntry{rule, 0, collectNodes(rule->node), rule->hidden,
+                                                 rule->cacheable, Lookahead(), false, {}});
+      ruleIndices[rule.get()] = index;
+      pending.push_back(index);
+      return index;
+    }
+
+    static Lookahead anything() {
+      Lookahead result;
+      result.first.set();
+      result.nullable = true;
+      return result;
+    }
+
+    /** lookahead of `node`, using the current approximation for referenced rules */
+    Lookahead analyze(const grammar::Node::Shared &node) {
+      using Symbol = grammar::Node::Symbol;
+
+      Lookahead result;
+      switch (node->symbol) {
+        case Symbol::WORD: {
+          auto &word = pget<std::string>(node->data);
+          if (word.empty()) {
+            result.nullable = true;
+          } else {
+            result.first.set(static_cast<unsigned char>(word[0]));
+          }
+          return result;
+        }
+
+        case Symbol::ANY: {
+          result.first.set();
+          return result;
+        }
+
+        case Symbol::RANGE: {
+          auto &v = pget<std::array<grammar::Letter, 2>>(node->data);
+          for (int c = v[0]; c <= v[1]; ++c) {
+            result.first.set(static_cast<unsigned char>(c));
+          }
+          return result;
+        }
+
+        case Symbol::SEQUENCE: {
+          // all nodes are visited to discover the referenced rules
+          result.nullable = true;
+          for (auto &n : pget<std::vector<grammar::Node::Shared>>(node->data)) {
+            auto inner = analyze(n);
+            if (result.nullable) {
+              result.first |= inner.first;
+              result.nullable = inner.nullable;
+            }
+          }
+          return result;
+        }
+
+        case Symbol::CHOICE: {
+          for (auto &n : pget<std::vector<grammar::Node::Shared>>(node->data)) {
+            auto inner = analyze(n);
+            result.first |= inner.first;
+            result.nullable |= inner.nullable;
+          }
+          return result;
+        }
+
+        case Symbol::ZERO_OR_MORE:
+        case Symbol::OPTIONAL: {
+          result = analyze(pget<grammar::Node::Shared>(node->data));
+          result.nullable = true;
+          return result;
+        }
+
+        case Symbol::ONE_OR_MORE: {
+          return analyze(pget<grammar::Node::Shared>(node->data));
+        }
+
+        case Symbol::ALSO:
+        case Symbol::NOT: {
+          analyze(pget<grammar::Node::Shared>(node->data));
+          result.nullable = true;
+          return result;
+        }
+
+        case Symbol::EMPTY:
+        case Symbol::END_OF_FILE: {
+          result.nullable = true;
+          return result;
+        }
+
+        case Symbol::ERROR: {
+          return result;
+        }
+
+        case Symbol::RULE: {
+          auto index = getRuleIndex(pget<std::shared_ptr<grammar::Rule>>(node->data));
+          return program.rules[index].lookahead;
+        }
+
+        case Symbol::WEAK_RULE: {
+          if (auto rule = pget<std::weak_ptr<grammar::Rule>>(node->data).lock()) {
+            return program.rules[getRuleIndex(rule)].lookahead;
+          }
+          // must stay reachable to raise the error
+          return anything();
+        }
+
+        case Symbol::FILTER: {
+          return anything();
+        }
+
+        case Symbol::CUT: {
+          result.nullable = true;
+          return result;
+        }
+
+        case Symbol::CAPTURE: {
+          return analyze(pget<std::pair<std::string, grammar::Node::Shared>>(node->data).second);
+        }
+      }
+
+      throw Parser::GrammarError(Parser::GrammarError::UNKNOWN_SYMBOL, node);
+    }
+
+    /** computes the lookahead of all rules reachable from the start rule as a fixed point */
+    void analyzeRules() {
+      bool changed = true;
+      while (changed) {
+        changed = false;
+        // rules discovered during the analysis are appended and visited in the same pass
+        for (size_t i = 0; i < program.rules.size(); ++i) {
+          auto lookahead = analyze(program.rules[i].rule->node);
+          if (lookahead != program.rules[i].lookahead) {
+            program.rules[i].lookahead = lookahead;
+            changed = true;
+          }
+        }
+      }
+    }
+
+    struct CallGraph {
+      /** rules called at the position a rule was entered at */
+      std::vector<std::vector<std::uint32_t>> leftCalls;
+      std::vector<size_t> callSites;
+      std::vector<bool> calledInPredicate;
+    };
+
+    void addCalls(const grammar::Node::Shared &node, std::uint32_t caller, bool atStart,
+                  bool inPredicate, CallGraph &graph) {
+      using Symbol = grammar::Node::Symbol;
+
+      auto addCall = [&](const std::shared_ptr<grammar::Rule> &rule) {
+        auto index = getRuleIndex(rule);
+        graph.callSites[index]++;
+        if (inPredicate) {
+          graph.calledInPredicate[index] = true;
+        }
+        if (atStart) {
+          graph.leftCalls[caller].push_back(index);
+        }
+      };
+
+      switch (node->symbol) {
+        case Symbol::SEQUENCE: {
+          for (auto &n : pget<std::vector<grammar::Node::Shared>>(node->data)) {
+            addCalls(n, caller, atStart, inPredicate, graph);
+            atStart = atStart && analyze(n).nullable;
+          }
+          return;
+        }
+        case Symbol::CHOICE: {
+          for (auto &n : pget<std::vector<grammar::Node::Shared>>(node->data)) {
+            addCalls(n, caller, atStart, inPredicate, graph);
+          }
+          return;
+        }
+        case Symbol::ZERO_OR_MORE:
+        case Symbol::ONE_OR_MORE:
+        case Symbol::OPTIONAL: {
+          addCalls(pget<grammar::Node::Shared>(node->data), caller, atStart, inPredicate, graph);
+          return;
+        }
+        case Symbol::ALSO:
+        case Symbol::NOT: {
+          addCalls(pget<grammar::Node::Shared>(node->data), caller, atStart, true, graph);
+          return;
+        }
+        case Symbol::CAPTURE: {
+          addCalls(pget<std::pair<std::string, grammar::Node::Shared>>(node->data).second, caller,
+                   atStart, inPredicate, graph);
+          return;
+        }
+        case Symbol::RULE: {
+          addCall(pget<std::shared_ptr<grammar::Rule>>(node->data));
+          return;
+        }
+        case Symbol::WEAK_RULE: {
+          if (auto rule = pget<std::weak_ptr<grammar::Rule>>(node->data).lock()) {
+            addCall(rule);
+          }
+          return;
+        }
+        default:
+          return;
+      }
+    }
+
+    /** selects the memoized rules according to `policy` */
+    void applyMemoizationPolicy(const MemoizationPolicy &policy) {
+      auto count = program.rules.size();
+      CallGraph graph{std::vector<std::vector<std::uint32_t>>(count), std::vector<size_t>(count),
+                      std::vector<bool>(count)};
+      for (std::uint32_t i = 0; i < count; ++i) {
+        addCalls(program.rules[i].rule->node, i, true, false, graph);
+      }
+
+      for (std::uint32_t i = 0; i < count; ++i) {
+        auto &entry = program.rules[i];
+        bool memoize = false;
+        switch (policy.mode) {
+          case MemoizationPolicy::Mode::NONE: {
+            break;
+          }
+          case MemoizationPolicy::Mode::FULL: {
+            memoize = true;
+            break;
+          }
+          case MemoizationPolicy::Mode::STATIC: {
+            memoize = graph.callSites[i] > 1 || graph.calledInPredicate[i];
+            break;
+          }
+          case MemoizationPolicy::Mode::ADAPTIVE: {
+            memoize = true;
+            if (policy.profile) {
+              auto it = policy.profile->rules.find(entry.rule->name);
+              if (it != policy.profile->rules.end()) {
+                auto &statistics = it->second;
+                memoize = double(statistics.hits)
+                          >= policy.minimumHitRate * double(statistics.invocations);
+              }
+            }
+            break;
+          }
+        }
+        entry.memoize = entry.cacheable && (memoize || isLeftRecursive(graph, i));
+      }
+    }
+
+    static bool isLeftRecursive(const CallGraph &graph, std::uint32_t rule) {
+      std::vector<bool> visited(graph.leftCalls.size());
+      std::vector<std::uint32_t> pending(graph.leftCalls[rule]);
+      while (!pending.empty()) {
+        auto current = pending.back();
+        pending.pop_back();
+        if (current == rule) {
+          return true;
+        }
+        if (!visited[current]) {
+          visited[current] = true;
+          pending.insert(pending.end(), graph.leftCalls[current].begin(),
+                         graph.leftCalls[current].end());
+        }
+      }
+      return false;
+    }
+
+    /**
+     * Compiles an ordered choice. Unless every alternative can start with any byte, `SELECT`
+     * instructions skip the alternatives that cannot match the current byte. The remaining
+     * alternatives are still tried in their original order.
+     */
+    void compileChoice(const std::vector<grammar::Node::Shared> &data) {
+      auto count = data.size();
+      std::vector<std::bitset<257>> viable(count);
+      bool dispatch = false;
+      for (size_t i = 0; i < count; ++i) {
+        auto lookahead = analyze(data[i]);
+        for (size_t c = 0; c < 256; ++c) {
+          viable[i][c] = lookahead.nullable || lookahead.first[c];
+        }
+        viable[i][DispatchTable::END_OF_INPUT] = lookahead.nullable;
+        dispatch |= !viable[i].all();
+      }
+
+      std::vector<std::uint32_t> alternatives(count), commits;
+      std::vector<std::uint32_t> selects(count, DispatchTable::NO_ALTERNATIVE);
+      auto select = [&](size_t i) {
+        if (dispatch && !viable[i].all()) {
+          selects[i] = emit(Opcode::SELECT, std::uint32_t(program.dispatchTables.size()));
+          program.dispatchTables.emplace_back();
+        }
+      };
+      select(0);
+      for (size_t i = 0; i + 1 < count; ++i) {
+        alternatives[i] = position();
+        auto choice = emit(Opcode::CHOICE);
+        cutTargets.push_back(openEntries);
+        compileGuarded(data[i]);
+        cutTargets.pop_back();
+        commits.push_back(emit(Opcode::COMMIT));
+        setTarget(choice, position());
+        select(i + 1);
+      }
+      alternatives.back() = position();
+      cutTargets.push_back(INVALID_CUT);
+      compileNode(data.back());
+      cutTargets.pop_back();
+      for (auto commit : commits) {
+        setTarget(commit, position());
+      }
+
+      for (size_t i = 0; i < count; ++i) {
+        if (selects[i] == DispatchTable::NO_ALTERNATIVE) {
+          continue;
+        }
+        auto &table = program.dispatchTables[program.instructions[selects[i]].argument];
+        for (size_t c = 0; c < table.targets.size(); ++c) {
+          table.targets[c] = DispatchTable::NO_ALTERNATIVE;
+          for (size_t j = i; j < count; ++j) {
+            if (viable[j][c]) {
+              table.targets[c] = alternatives[j];
+              break;
+            }
+          }
+        }
+      }
+    }
+
+    /** collects the members of `node` if it always matches exactly one byte out of a set */
+    static bool getCharacterClass(const grammar::Node::Shared &node, std::bitset<256> &members) {
+      using Symbol = grammar::Node::Symbol;
+
+      switch (node->symbol) {
+        case Symbol::WORD: {
+          auto &word = pget<std::string>(node->data);
+          if (word.size() != 1) {
+            return false;
+          }
+          members.set(static_cast<unsigned char>(word[0]));
+          return true;
+        }
+
+        case Symbol::ANY: {
+          members.set();
+          return true;
+        }
+
+        case Symbol::RANGE: {
+          auto &v = pget<std::array<grammar::Letter, 2>>(node->data);
+          for (int c = v[0]; c <= v[1]; ++c) {
+            members.set(static_cast<unsigned char>(c));
+          }
+          return true;
+        }
+
+        case Symbol::CHOICE: {
+          auto &data = pget<std::vector<grammar::Node::Shared>>(node->data);
+          for (auto &n : data) {
+            if (!getCharacterClass(n, members)) {
+              return false;
+            }
+          }
+          return !data.empty();
+        }
+
+        case Symbol::SEQUENCE: {
+          // `!excluded included`
+          auto &data = pget<std::vector<grammar::Node::Shared>>(node->data);
+          if (data.size() != 2 || data[0]->symbol != Symbol::NOT) {
+            return false;
+          }
+          std::bitset<256> excluded, included;
+          if (!getCharacterClass(pget<grammar::Node::Shared>(data[0]->data), excluded)
+              || !getCharacterClass(data[1], included)) {
+            return false;
+          }
+          members |= included & ~excluded;
+          return true;
+        }
+
+        default:
+          return false;
+      }
+    }
+
+    /** the delimiter of `!'delimiter' .`, or `nullptr` if `node` has a different form */
+    static const std::string *getScanDelimiter(const grammar::Node::Shared &node) {
+      using Symbol = grammar::Node::Symbol;
+
+      if (node->symbol != Symbol::SEQUENCE) {
+        return nullptr;
+      }
+      auto &data = pget<std::vector<grammar::Node::Shared>>(node->data);
+      if (data.size() != 2 || data[0]->symbol != Symbol::NOT || data[1]->symbol != Symbol::ANY) {
+        return nullptr;
+      }
+      auto &word = pget<grammar::Node::Shared>(data[0]->data);
+      return word->symbol == Symbol::WORD ? &pget<std::string>(word->data) : nullptr;
+    }
+
+    static bool isKeyword(const grammar::Node::Shared &node) {
+      return node->symbol == grammar::Node::Symbol::WORD && !pget<std::string>(node->data).empty();
+    }
+
+    /** replaces runs of literal alternatives by a choice that is matched with a keyword table */
+    static std::vector<grammar::Node::Shared> groupKeywords(
+        const std::vector<grammar::Node::Shared> &data) {
+      std::vector<grammar::Node::Shared> result;
+      for (auto it = data.begin(); it != data.end();) {
+        auto end = std::find_if_not(it, data.end(), isKeyword);
+        if (end - it >= 2) {
+          result.push_back(grammar::Node::Choice(std::vector<grammar::Node::Shared>(it, end)));
+          it = end;
+        } else {
+          result.push_back(*it++);
+        }
+      }
+      return result;
+    }
+
+    std::uint32_t addKeywordTable(const std::vector<grammar::Node::Shared> &data) {
+      std::vector<std::string> alternatives;
+      for (auto &n : data) {
+        alternatives.push_back(pget<std::string>(n->data));
+      }
+      program.keywordTables.emplace_back(alternatives);
+      return std::uint32_t(program.keywordTables.size() - 1);
+    }
+
+    std::uint32_t addCharacterClass(const std::bitset<256> &members) {
+      program.characterClasses.emplace_back(members);
+      return std::uint32_t(program.characterClasses.size() - 1);
+    }
+
+    void compileNode(const grammar::Node::Shared &node) {
+      using Symbol = grammar::Node::Symbol;
+
+      switch (node->symbol) {
+        case Symbol::WORD: {
+          program.words.push_back(pget<std::string>(node->data));
+          emit(Opcode::WORD, std::uint32_t(program.words.size() - 1));
+          return;
+        }
+
+        case Symbol::ANY: {
+          emit(Opcode::ANY);
+          return;
+        }
+
+        case Symbol::RANGE: {
+          auto &v = pget<std::array<grammar::Letter, 2>>(node->data);
+          program.instructions.emplace_back(Opcode::RANGE, v[0], v[1]);
+          return;
+        }
+
+        case Symbol::SEQUENCE: {
+          for (auto &n : pget<std::vector<grammar::Node::Shared>>(node->data)) {
+            compileNode(n);
+          }
+          return;
+        }
+
+        case Symbol::CHOICE: {
+          const auto &data = pget<std::vector<grammar::Node::Shared>>(node->data);
+          if (data.empty()) {
+            emit(Opcode::FAIL);
+            return;
+          }
+          std::bitset<256> members;
+          if (getCharacterClass(node, members)) {
+            emit(Opcode::SET, addCharacterClass(members));
+            return;
+          }
+          if (data.size() >= 2 && std::all_of(data.begin(), data.end(), isKeyword)) {
+            emit(Opcode::KEYWORDS, addKeywordTable(data));
+            return;
+          }
+          compileChoice(groupKeywords(data));
+          return;
+        }
+
+        case Symbol::ZERO_OR_MORE: {
+          compileRepetition(pget<grammar::Node::Shared>(node->data));
+          return;
+        }
+
+        case Symbol::ONE_OR_MORE: {
+          const auto &data = pget<grammar::Node::Shared>(node->data);
+          std::bitset<256> members;
+          if (getCharacterClass(data, members)) {
+            auto index = addCharacterClass(members);
+            emit(Opcode::SET, index);
+            emit(Opcode::SPAN, index);
+            return;
+          }
+          // the first iteration cannot be skipped
+          cutTargets.push_back(Instruction::NO_CUT_TARGET);
+          compileNode(data);
+          cutTargets.pop_back();
+          compileRepetition(data);
+          return;
+        }
+
+        case Symbol::OPTIONAL: {
+          auto choice = emit(Opcode::CHOICE);
+          cutTargets.push_back(openEntries);
+          compileGuarded(pget<grammar::Node::Shared>(node->data));
+          cutTargets.pop_back();
+          auto commit = emit(Opcode::COMMIT);
+          setTarget(choice, position());
+          setTarget(commit, position());
+          return;
+        }
+
+        case Symbol::ALSO: {
+          auto choice = emit(Opcode::CHOICE);
+          cutTargets.push_back(INVALID_CUT);
+          compileGuarded(pget<grammar::Node::Shared>(node->data));
+          cutTargets.pop_back();
+          auto commit = emit(Opcode::BACK_COMMIT);
+          setTarget(choice, emit(Opcode::FAIL));
+          setTarget(commit, position());
+          return;
+        }
+
+        case Symbol::NOT: {
+          auto choice = emit(Opcode::CHOICE);
+          cutTargets.push_back(INVALID_CUT);
+          compileGuarded(pget<grammar::Node::Shared>(node->data));
+          cutTargets.pop_back();
+          emit(Opcode::FAIL_TWICE);
+          setTarget(choice, position());
+          return;
+        }
+
+        case Symbol::EMPTY: {
+          return;
+        }
+
+        case Symbol::ERROR: {
+          emit(Opcode::FAIL);
+          return;
+        }
+
+        case Symbol::RULE: {
+          emit(Opcode::CALL, getRuleIndex(pget<std::shared_ptr<grammar::Rule>>(node->data)));
+          return;
+        }
+
+        case Symbol::WEAK_RULE: {
+          if (auto rule = pget<std::weak_ptr<grammar::Rule>>(node->data).lock()) {
+            emit(Opcode::CALL, getRuleIndex(rule));
+          } else {
+            // deleted rules are only an error once the parser tries to enter them
+            program.invalidNodes.push_back(node);
+            emit(Opcode::INVALID_RULE, std::uint32_t(program.invalidNodes.size() - 1));
+          }
+          return;
+        }
+
+        case Symbol::END_OF_FILE: {
+          emit(Opcode::END_OF_FILE);
+          return;
+        }
+
+        case Symbol::FILTER: {
+          program.filters.push_back(pget<grammar::Node::FilterCallback>(node->data));
+          emit(Opcode::FILTER, std::uint32_t(program.filters.size() - 1));
+          return;
+        }
+
+        case Symbol::CUT: {
+          if (cutTargets.empty() || cutTargets.back() == INVALID_CUT) {
+            throw Parser::GrammarError(Parser::GrammarError::INVALID_CUT, ruleNode);
+          }
+          if (cutTargets.back() == Instruction::NO_CUT_TARGET) {
+            emit(Opcode::CUT, Instruction::NO_CUT_TARGET);
+          } else {
+            // distance of the choice's entry from the top of the backtrack stack
+            emit(Opcode::CUT, openEntries - 1 - cutTargets.back());
+          }
+          return;
+        }
+
+        case Symbol::CAPTURE: {
+          // labels are resolved after compiling the rules and do not affect parsing
+          compileNode(pget<std::pair<std::string, grammar::Node::Shared>>(node->data).second);
+          return;
+        }
+      }
+
+      throw Parser::GrammarError(Parser::GrammarError::UNKNOWN_SYMBOL, node);
+    }
+
+    /** compiles `node*`, the body is retried until it fails */
+    void compileRepetition(const grammar::Node::Shared &node) {
+      std::bitset<256> members;
+      if (getCharacterClass(node, members)) {
+        emit(Opcode::SPAN, addCharacterClass(members));
+        return;
+      }
+      if (auto delimiter = getScanDelimiter(node)) {
+        program.words.push_back(*delimiter);
+        emit(Opcode::SCAN, std::uint32_t(program.words.size() - 1));
+        return;
+      }
+      auto choice = emit(Opcode::CHOICE);
+      auto body = position();
+      cutTargets.push_back(openEntries);
+      compileGuarded(node);
+      cutTargets.pop_back();
+      emit(Opcode::PARTIAL_COMMIT, body);
+      setTarget(choice, position());
+    }
+
+    /** compiles a node that is executed while one more backtrack entry is on the stack */
+    void compileGuarded(const grammar::Node::Shared &node) {
+      ++openEntries;
+      compileNode(node);
+      --openEntries;
+    }
+
+  public:
+    explicit Compiler(Program &p) : program(p) {}
+
+    void compile(const std::shared_ptr<grammar::Rule> &start, const MemoizationPolicy &policy) {
+      emit(Opcode::CALL, getRuleIndex(start));
+      emit(Opcode::END);
+      analyzeRules();
+      program.memoization = policy;
+      applyMemoizationPolicy(policy);
+      while (!pending.empty()) {
+        auto index = pending.back();
+        pending.pop_back();
+        program.rules[index].entry = position();
+        ruleNode = program.rules[index].rule->node;
+        compileNode(ruleNode);
+        emit(Opcode::RETURN);
+      }
+      // the child positions of labels depend on the hidden flags of the referenced rules
+      for (auto &entry : program.rules) {
+        entry.labels = grammar::resolveLabels(entry.rule->node);
+      }
+      program.ruleIndices = std::move(ruleIndices);
+    }
+  };
+
+}  // namespace
+
+KeywordTable::KeywordTable(const std::vector<std::string> &alternatives) {
+  // stable counting sort by the first byte
+  buckets.fill(0);
+  for (auto &keyword : alternatives) {
+    ++buckets[static_cast<unsigned char>(keyword[0]) + 1];
+  }
+  for (size_t c = 1; c < buckets.size(); ++c) {
+    buckets[c] += buckets[c - 1];
+  }
+  keywords.resize(alternatives.size());
+  auto next = buckets;
+  for (auto &keyword : alternatives) {
+    keywords[next[static_cast<unsigned char>(keyword[0])]++] = keyword;
+  }
+}
+
+size_t KeywordTable::match(std::string_view string, size_t position, bool complete) const {
+  if (position >= string.size()) {
+    return complete ? NO_MATCH : NEEDS_INPUT;
+  }
+  auto c = static_cast<unsigned char>(string[position]);
+  auto remaining = string.size() - position;
+  for (auto i = buckets[c]; i < buckets[c + 1]; ++i) {
+    auto &keyword = keywords[i];
+    auto length = std::min(keyword.size(), remaining);
+    if (std::memcmp(string.data() + position, keyword.data(), length) != 0) {
+      continue;
+    }
+    if (length == keyword.size()) {
+      return length;
+    }
+    if (!complete) {
+      return NEEDS_INPUT;
+    }
+  }
+  return NO_MATCH;
+}
+
+bool Program::isCompiledFrom(const std::shared_ptr<grammar::Rule> &start,
+                             const MemoizationPolicy &policy) const {
+  if (rules.empty() || rules[0].rule != start || memoization != policy) {
+    return false;
+  }
+  for (auto &entry : rules) {
+    auto &rule = *entry.rule;
+    if (rule.hidden != entry.hidden || rule.cacheable != entry.cacheable) {
+      return false;
+    }
+    // the compiled nodes are kept alive, so a replaced node cannot reuse their address
+    size_t index = 0;
+    auto unchanged = visitNodes(rule.node, [&](const grammar::Node::Shared &node) {
+      return index < entry.nodes.size() && entry.nodes[index++] == node;
+    });
+    if (!unchanged || index != entry.nodes.size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::shared_ptr<const Program> bytecode::compile(const std::shared_ptr<grammar::Rule> &start,
+                                                 const MemoizationPolicy &policy) {
+  auto program = std::make_shared<Program>();
+  Compiler(*program).compile(start, policy);
+  return program;
+}
+
+std::ostream &bytecode::operator<<(std::ostream &stream, const Program &program) {
+  for (auto &&[i, instruction] : easy_iterator::enumerate(program.instructions)) {
+    for (auto &rule : program.rules) {
+      if (rule.entry == i) {
+        stream << rule.rule->name << ":\n";
+      }
+    }
+    stream << "  " << i << ": ";
+    auto argument = instruction.argument;
+    switch (instruction.opcode) {
+      case Opcode::WORD:
+        stream << "word '" << program.words[argument] << "'";
+        break;
+      case Opcode::ANY:
+        stream << "any";
+        break;
+      case Opcode::RANGE:
+        stream << "range [" << instruction.from << "-" << instruction.to << "]";
+        break;
+      case Opcode::END_OF_FILE:
+        stream << "eof";
+        break;
+      case Opcode::FILTER:
+        stream << "filter " << argument;
+        break;
+      case Opcode::CALL:
+        stream << "call " << program.rules[argument].rule->name;
+        break;
+      case Opcode::RETURN:
+        stream << "return";
+        break;
+      case Opcode::CHOICE:
+        stream << "choice " << argument;
+        break;
+      case Opcode::COMMIT:
+        stream << "commit " << argument;
+        break;
+      case Opcode::PARTIAL_COMMIT:
+        stream << "partial_commit " << argument;
+        break;
+      case Opcode::BACK_COMMIT:
+        stream << "back_commit " << argument;
+        break;
+      case Opcode::FAIL:
+        stream << "fail";
+        break;
+      case Opcode::FAIL_TWICE:
+        stream << "fail_twice";
+        break;
+      case Opcode::INVALID_RULE:
+        stream << "invalid_rule " << *program.invalidNodes[argument];
+        break;
+      case Opcode::SELECT:
+        stream << "select " << argument;
+        break;
+      case Opcode::KEYWORDS:
+        stream << "keywords";
+        for (auto &keyword : program.keywordTables[argument].getKeywords()) {
+          stream << " '" << keyword << "'";
+        }
+        break;
+      case Opcode::CUT:
+        stream << "cut";
+        if (argument != Instruction::NO_CUT_TARGET) {
+          stream << " " << argument;
+        }
+        break;
+      case Opcode::SCAN:
+        stream << "scan '" << program.words[argument] << "'";
+        break;
+      case Opcode::SET:
+      case Opcode::SPAN: {
+        stream << (instruction.opcode == Opcode::SET ? "set" : "span");
+        for (auto &range : program.characterClasses[argument].getRanges()) {
+          stream << " " << int(range.from) << "-" << int(range.to);
+        }
+        break;
+      }
+      case Opcode::END:
+        stream << "end";
+        break;
+    }
+    stream << '\n';
+  }
+  return stream;
+}
@@ -0,0 +1,117 @@
+#include <peg_parser/bytecode.h>
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define PEG_PARSER_SSE2
+#  include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+using namespace peg_parser::bytecode;
+
+namespace {
+
+  /** classes with more ranges are matched by table lookups */
+  constexpr size_t MAX_VECTORIZED_RANGES = 4;
+
+  inline unsigned countTrailingZeros(std::uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return unsigned(index);
+#else
+    return unsigned(__builtin_ctz(mask));
+#endif
+  }
+
+#if defined(__AVX2__)
+
+  size_t vectorizedSpan(const std::uint8_t *data, size_t position, size_t size,
+                        const std::vector<CharacterClass::Range> &ranges) {
+    __m256i from[MAX_VECTORIZED_RANGES], width[MAX_VECTORIZED_RANGES];
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      from[i] = _mm256_set1_epi8(char(ranges[i].from));
+      width[i] = _mm256_set1_epi8(char(ranges[i].to - ranges[i].from));
+    }
+    for (; position + 32 <= size; position += 32) {
+      auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + position));
+      auto match = _mm256_setzero_si256();
+      for (size_t i = 0; i < ranges.size(); ++i) {
+        // c - from <= to - from as unsigned bytes
+        auto offset = _mm256_sub_epi8(chunk, from[i]);
+        match = _mm256_or_si256(
+            match, _mm256_cmpeq_epi8(_mm256_min_epu8(offset, width[i]), offset));
+      }
+      auto mismatches = ~std::uint32_t(_mm256_movemask_epi8(match));
+      if (mismatches) {
+        return position + countTrailingZeros(mismatches);
+      }
+    }
+    return position;
+  }
+
+#elif defined(PEG_PARSER_SSE2)
+
+  size_t vectorizedSpan(const std::uint8_t *data, size_t position, size_t size,
+                        const std::vector<CharacterClass::Range> &ranges) {
+    __m128i from[MAX_VECTORIZED_RANGES], width[MAX_VECTORIZED_RANGES];
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      from[i] = _mm_set1_epi8(char(ranges[i].from));
+      width[i] = _mm_set1_epi8(char(ranges[i].to - ranges[i].from));
+    }
+    for (; position + 16 <= size; position += 16) {
+      auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + position));
+      auto match = _mm_setzero_si128();
+      for (size_t i = 0; i < ranges.size(); ++i) {
+        // c - from <= to - from as unsigned bytes
+        auto offset = _mm_sub_epi8(chunk, from[i]);
+        match = _mm_or_si128(match, _mm_cmpeq_epi8(_mm_min_epu8(offset, width[i]), offset));
+      }
+      auto mismatches = ~std::uint32_t(_mm_movemask_epi8(match)) & 0xFFFF;
+      if (mismatches) {
+        return position + countTrailingZeros(mismatches);
+      }
+    }
+    return position;
+  }
+
+#else
+
+  size_t vectorizedSpan(const std::uint8_t *, size_t position, size_t,
+                        const std::vector<CharacterClass::Range> &) {
+    return position;
+  }
+
+#endif
+
+}  // namespace
+
+CharacterClass::CharacterClass(const std::bitset<256> &members) {
+  for (size_t c = 0; c < 256; ++c) {
+    table[c] = members[c];
+    if (!members[c]) {
+      continue;
+    }
+    if (!ranges.empty() && ranges.back().to + 1u == c) {
+      ranges.back().to = std::uint8_t(c);
+    } else {
+      ranges.push_back(Range{std::uint8_t(c), std::uint8_t(c)});
+    }
+  }
+}
+
+size_t CharacterClass::span(std::string_view string, size_t position) const {
+  auto data = reinterpret_cast<const std::uint8_t *>(string.data());
+  auto size = string.size();
+  if (ranges.size() <= MAX_VECTORIZED_RANGES) {
+    position = vectorizedSpan(data, position, size, ranges);
+  }
+  while (position < size && table[data[position]]) {
+    ++position;
+  }
+  return position;
+}
@@ -2,6 +2,9 @@
 #include <peg_parser/grammar.h>
 #include <peg_parser/interpreter.h>
 
+#include <algorithm>
+#include <limits>
+
 using namespace peg_parser::grammar;
 
 namespace {
@@ -15,8 +18,185 @@ namespace {
     }
   }
 
+  /** the minimum and maximum number of children a node adds to the tree of its rule */
+  struct ChildCount {
+    static constexpr size_t UNBOUNDED = std::numeric_limits<size_t>::max();
+    size_t min = 0, max = 0;
+
+    bool fixed() const { return min == max; }
+    ChildCount &operator+=(const ChildCount &other) {
+      min += other.min;
+      max = max == UNBOUNDED || other.max == UNBOUNDED ? UNBOUNDED : max + other.max;
+      return *this;
+    }
+  };
+
+  ChildCount countChildren(const Node::Shared &node) {
+    using Symbol = Node::Symbol;
+
+    switch (node->symbol) {
+      case Symbol::SEQUENCE: {
+        ChildCount result;
+        for (auto &n : pget<std::vector<Node::Shared>>(node->data)) {
+          result += countChildren(n);
+        }
+        return result;
+      }
+
+      case Symbol::CHOICE: {
+        auto &data = pget<std::vector<Node::Shared>>(node->data);
+        if (data.empty()) {
+          return ChildCount();
+        }
+        ChildCount result{ChildCount::UNBOUNDED, 0};
+        for (auto &n : data) {
+          auto count = countChildren(n);
+          result.min = std::min(result.min, count.min);
+          result.max = std::max(result.max, count.max);
+        }
+        return result;
+      }
+
+      case Symbol::ZERO_OR_MORE:
+      case Symbol::ONE_OR_MORE:
+      case Symbol::OPTIONAL: {
+        auto count = countChildren(pget<Node::Shared>(node->data));
+        if (node->symbol != Symbol::ONE_OR_MORE) {
+          count.min = 0;
+        }
+        if (node->symbol != Symbol::OPTIONAL && count.max > 0) {
+          count.max = ChildCount::UNBOUNDED;
+        }
+        return count;
+      }
+
+      case Symbol::RULE: {
+        auto hidden = pget<std::shared_ptr<Rule>>(node->data)->hidden;
+        return ChildCount{hidden ? 0u : 1u, hidden ? 0u : 1u};
+      }
+
+      case Symbol::WEAK_RULE: {
+        auto rule = pget<std::weak_ptr<Rule>>(node->data).lock();
+        auto visible = rule && !rule->hidden;
+        return ChildCount{visible ? 1u : 0u, visible ? 1u : 0u};
+      }
+
+      case Symbol::CAPTURE: {
+        return countChildren(pget<std::pair<std::string, Node::Shared>>(node->data).second);
+      }
+
+      default:
+        // terminals and predicates, whose children are discarded
+        return ChildCount();
+    }
+  }
+
+  bool containsCapture(const Node::Shared &node) {
+    using Symbol = Node::Symbol;
+
+    switch (node->symbol) {
+      case Symbol::SEQUENCE:
+      case Symbol::CHOICE: {
+        auto &data = pget<std::vector<Node::Shared>>(node->data);
+        return std::any_of(data.begin(), data.end(), containsCapture);
+      }
+      case Symbol::ZERO_OR_MORE:
+      case Symbol::ONE_OR_MORE:
+      case Symbol::OPTIONAL:
+      case Symbol::ALSO:
+      case Symbol::NOT: {
+        return containsCapture(pget<Node::Shared>(node->data));
+      }
+      case Symbol::CAPTURE: {
+        return true;
+      }
+      default:
+        return false;
+    }
+  }
+
+  /** appends the elements of the top-level sequence of a rule's grammar */
+  void flattenSequence(const Node::Shared &node, std::vector<Node::Shared> &elements) {
+    if (node->symbol == Node::Symbol::SEQUENCE) {
+      for (auto &n : pget<std::vector<Node::Shared>>(node->data)) {
+        flattenSequence(n, elements);
+      }
+    } else {
+      elements.push_back(node);
+    }
+  }
+
 }  // namespace
 
+Rule::Rule(const std::string_view &n, const std::shared_ptr<Node> &t)
+    : name(n), node(t) {}
+
+std::vector<Label> peg_parser::grammar::resolveLabels(const Node::Shared &node) {
+  using Symbol = Node::Symbol;
+
+  std::vector<Label> labels;
+  if (!node) {
+    return labels;
+  }
+
+  std::vector<Node::Shared> elements;
+  flattenSequence(node, elements);
+  std::vector<ChildCount> counts;
+  size_t variable = 0;
+  for (auto &element : elements) {
+    counts.push_back(countChildren(element));
+    variable += !counts.back().fixed();
+  }
+
+  auto invalid = [](const Node::Shared &n) {
+    return peg_parser::Parser::GrammarError(peg_parser::Parser::GrammarError::INVALID_LABEL, n);
+  };
+
+  for (size_t i = 0; i < elements.size(); ++i) {
+    auto &element = elements[i];
+    if (element->symbol != Symbol::CAPTURE) {
+      if (containsCapture(element)) {
+        throw invalid(element);
+      }
+      continue;
+    }
+    auto &[name, captured] = pget<std::pair<std::string, Node::Shared>>(element->data);
+    if (containsCapture(captured) || counts[i].max != 1) {
+      throw invalid(element);
+    }
+
+    ChildCount before, after;
+    for (size_t j = 0; j < elements.size(); ++j) {
+      if (j < i) {
+        before += counts[j];
+      } else if (j > i) {
+        after += counts[j];
+      }
+    }
+
+    Label label;
+    label.name = name;
+    if (counts[i].min == 0) {
+      // the capture is present if and only if the tree has the maximum number of children
+      if (variable > 1) {
+        throw invalid(element);
+      }
+      label.offset = before.min;
+      label.presentSize = before.min + 1 + after.min;
+    } else if (before.fixed()) {
+      label.offset = before.min;
+    } else if (after.fixed()) {
+      label.offset = after.min;
+      label.fromEnd = true;
+    } else {
+      throw invalid(element);
+    }
+    labels.push_back(label);
+  }
+
+  return labels;
+}
+
 std::ostream &peg_parser::grammar::operator<<(std::ostream &stream, const Node &node) {
   using Symbol = peg_parser::grammar::Node::Symbol;
 
@@ -117,6 +297,17 @@ std::ostream &peg_parser::grammar::operator<<(std::ostream &stream, const Node &
       stream << "<Filter>";
       break;
     }
+
+    case Node::Symbol::CUT: {
+      stream << "^";
+      break;
+    }
+
+    case Node::Symbol::CAPTURE: {
+      auto &[label, captured] = pget<std::pair<std::string, Node::Shared>>(node.data);
+      stream << label << ":" << *captured;
+      break;
+    }
   }
 
   return stream;
@@ -1,20 +1,36 @@
 #include <peg_parser/interpreter.h>
 
 #include <string>
+#include <vector>
 
 using namespace peg_parser;
 
 const char *InterpreterError::what() const noexcept {
   if (buffer.size() == 0) {
-    buffer = "no evaluator for rule '" + tree->rule->name + "'";
+    buffer = "no evaluator for rule '" + rule->name + "'";
   }
   return buffer.c_str();
 }
 
 const char *SyntaxError::what() const noexcept {
   if (buffer.size() == 0) {
-    buffer = "syntax error at character " + std::to_string(syntax->end + 1) + " while parsing "
+    auto position = diagnosis ? diagnosis->position : syntax->end;
+    buffer = "syntax error at character " + std::to_string(position + 1) + " while parsing "
              + syntax->rule->name;
+    if (diagnosis) {
+      // terminals are more specific than the rules they have failed in
+      std::vector<std::string> expected = diagnosis->terminals;
+      if (expected.empty()) {
+        for (auto &rule : diagnosis->rules) {
+          if (rule != syntax->rule) {
+            expected.push_back(rule->name);
+          }
+        }
+      }
+      for (size_t i = 0; i < expected.size(); ++i) {
+        buffer += (i == 0 ? ", expected " : " or ") + expected[i];
+      }
+    }
   }
   return buffer.c_str();
 }
@@ -0,0 +1,50 @@
+#include <peg_parser/memoization.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace peg_parser;
+
+void MemoizationProfile::save(std::ostream &stream) const {
+  for (auto &[name, entry] : rules) {
+    stream << entry.invocations << ' ' << entry.hits << ' ' << name << '\n';
+  }
+}
+
+void MemoizationProfile::load(std::istream &stream) {
+  std::string line;
+  while (std::getline(stream, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    std::istringstream fields(line);
+    Entry entry;
+    std::string name;
+    if (!(fields >> entry.invocations >> entry.hits) || fields.get() != ' '
+        || !std::getline(fields, name)) {
+      throw std::runtime_error("invalid memoization profile entry: " + line);
+    }
+    auto &stored = rules[name];
+    stored.invocations += entry.invocations;
+    stored.hits += entry.hits;
+  }
+}
+
+void MemoizationProfile::saveFile(const std::string &path) const {
+  std::ofstream stream(path);
+  if (!stream) {
+    throw std::runtime_error("cannot write memoization profile: " + path);
+  }
+  save(stream);
+}
+
+MemoizationProfile MemoizationProfile::loadFile(const std::string &path) {
+  std::ifstream stream(path);
+  if (!stream) {
+    throw std::runtime_error("cannot read memoization profile: " + path);
+  }
+  MemoizationProfile profile;
+  profile.load(stream);
+  return profile;
+}
@@ -3,9 +3,25 @@
 #include <peg_parser/parser.h>
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory_resource>
 #include <sstream>
-#include <stack>
-#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+
+#if defined(__unix__) || defined(__APPLE__)
+#  define PEG_PARSER_MMAP
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#else
+#  include <fstream>
+#endif
 
 // Macros for debugging parsers
 // #define PEG_PARSER_TRACE
@@ -34,58 +50,484 @@ namespace {
 #  define DECREASE_INDENT
 #endif
 
+using namespace peg_parser;
+
 namespace {
 
-  /**  alternative to `std::get` that works on iOS < 11 */
-  template <class T, class V> const T &pget(const V &v) {
-    if (auto r = std::get_if<T>(&v)) {
-      return *r;
-    } else {
-      throw std::runtime_error("corrupted grammar node");
+  template <class T> std::string streamToString(T &&v) {
+    std::stringstream stream;
+    stream << v;
+    return stream.str();
+  }
+
+  /**
+   * The first occurrence of `word` in `string` at or after `position`, or the end of the string.
+   * Candidates are located by searching for the first byte.
+   */
+  size_t findWord(std::string_view string, size_t position, const std::string &word) {
+    if (word.empty()) {
+      return position;
+    }
+    auto data = string.data();
+    while (position < string.size()) {
+      auto candidate = static_cast<const char *>(
+          std::memchr(data + position, word[0], string.size() - position));
+      if (!candidate) {
+        break;
+      }
+      position = size_t(candidate - data);
+      if (string.compare(position, word.size(), word) == 0) {
+        return position;
+      }
+      ++position;
     }
+    return string.size();
   }
 
-}  // namespace
+  /** a character class such as `[0-9A-Z]` listing the bytes for which `contains` is true */
+  template <class F> std::string describeCharacters(const F &contains) {
+    std::string description = "[";
+    size_t count = 0;
+    for (size_t c = 0; c < 256; ++c) {
+      if (!contains(c)) {
+        continue;
+      }
+      auto end = c;
+      while (end + 1 < 256 && contains(end + 1)) {
+        ++end;
+      }
+      description += char(c);
+      if (end > c) {
+        description += '-';
+        description += char(end);
+      }
+      count += end - c + 1;
+      c = end;
+    }
+    return count == 256 ? "any character" : description + "]";
+  }
 
-using namespace peg_parser;
+  /**
+   * Packrat memo table indexed by rule index and position. Each rule owns a column of lazily
+   * allocated chunks holding the syntax trees of successful invocations. Failed and currently
+   * active invocations only set a bit. Chunks before a position the parser cannot return to can
+   * be discarded, the remaining chunks are then indexed relative to the column's offset.
+   *
+   * Tables used for incremental parsing also store how far each invocation has read the input,
+   * which determines the entries that remain valid after an edit.
+   */
+  class MemoTable {
+  private:
+    static constexpr size_t CHUNK_BITS = 6;
+    static constexpr size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+    static constexpr size_t CHUNK_MASK = CHUNK_SIZE - 1;
+    static constexpr size_t DISCARDED = std::numeric_limits<size_t>::max();
+    /** stored for invocations that have read further than the largest representable distance */
+    static constexpr std::uint32_t UNBOUNDED = std::numeric_limits<std::uint32_t>::max();
 
-namespace {
+    using Bits = std::vector<std::uint64_t>;
 
-  // Code from boost
-  // Reciprocal of the golden ratio helps spread entropy
-  //     and handles duplicates.
-  // See Mike Seymour in magic-numbers-in-boosthash-combine:
-  //     http://stackoverflow.com/questions/4948780
+    struct Chunk {
+      std::array<std::shared_ptr<SyntaxTree>, CHUNK_SIZE> trees;
+    };
 
-  template <class T> inline void hash_combine(std::size_t &seed, T const &v) {
-    seed ^= std::hash<T>()(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-  }
+    /** the distance from each entry's position to the furthest position it has reached */
+    struct Reach {
+      std::array<std::uint32_t, CHUNK_SIZE> distances;
+      /** the furthest position reached by any entry of the chunk */
+      size_t furthest = 0;
+    };
+
+    struct Column {
+      /** the index of the first chunk that has not been discarded */
+      size_t offset = 0;
+      Bits failures;
+      Bits active;
+      std::vector<std::unique_ptr<Chunk>> chunks;
+      std::vector<std::unique_ptr<Reach>> reach;
+      /** the number of leading chunks that may hold entries, bounds the work of `clear` */
+      size_t touched = 0;
+
+      /** the index of the chunk containing `position` or `DISCARDED` */
+      size_t index(size_t position) const {
+        auto chunk = position >> CHUNK_BITS;
+        return chunk < offset ? DISCARDED : chunk - offset;
+      }
+    };
+
+    std::vector<Column> columns;
+    bool tracksReach;
+
+  public:
+    explicit MemoTable(size_t rules, bool r = false) : columns(rules), tracksReach(r) {}
+
+    /** the first position of the chunk containing `position` */
+    static size_t chunkBegin(size_t position) { return position & ~CHUNK_MASK; }
+
+    /** the tree stored for `rule` at `position` or `nullptr` */
+    const std::shared_ptr<SyntaxTree> *find(std::uint32_t rule, size_t position) const {
+      auto &column = columns[rule];
+      auto index = column.index(position);
+      if (index < column.chunks.size() && column.chunks[index]) {
+        auto &tree = column.chunks[index]->trees[position & CHUNK_MASK];
+        if (tree) {
+          return &tree;
+        }
+      }
+      return nullptr;
+    }
 
-  // Recursive template code derived from Matthieu M.
-  template <class Tuple, size_t Index = std::tuple_size<Tuple>::value - 1> struct HashValueImpl {
-    static void apply(size_t &seed, Tuple const &tuple) {
-      HashValueImpl<Tuple, Index - 1>::apply(seed, tuple);
-      hash_combine(seed, std::get<Index>(tuple));
+    bool hasFailed(std::uint32_t rule, size_t position) const {
+      return getBit(columns[rule], columns[rule].failures, position);
     }
-  };
 
-  template <class Tuple> struct HashValueImpl<Tuple, 0> {
-    static void apply(size_t &seed, Tuple const &tuple) { hash_combine(seed, std::get<0>(tuple)); }
-  };
+    bool isActive(std::uint32_t rule, size_t position) const {
+      return getBit(columns[rule], columns[rule].active, position);
+    }
+
+    /** the furthest position reached by the stored invocation of `rule` at `position` */
+    size_t getReached(std::uint32_t rule, size_t position, size_t end) const {
+      auto &column = columns[rule];
+      auto index = column.index(position);
+      if (!tracksReach || index >= column.reach.size() || !column.reach[index]) {
+        return position;
+      }
+      auto distance = column.reach[index]->distances[position & CHUNK_MASK];
+      return distance == UNBOUNDED ? end : position + distance;
+    }
+
+    void store(std::uint32_t rule, const std::shared_ptr<SyntaxTree> &tree, size_t reached) {
+      auto &column = columns[rule];
+      auto index = column.index(tree->begin);
+      if (index == DISCARDED) {
+        return;
+      }
+      storeTree(column, index, tree->begin, tree);
+      setBit(column, column.failures, tree->begin, false);
+      setBit(column, column.active, tree->begin, false);
+      storeReach(column, index, tree->begin, reached);
+    }
+
+    void storeActive(std::uint32_t rule, size_t position) {
+      setBit(columns[rule], columns[rule].active, position, true);
+    }
+
+    void storeFailure(std::uint32_t rule, size_t position, size_t reached) {
+      auto &column = columns[rule];
+      if (find(rule, position)) {
+        column.chunks[column.index(position)]->trees[position & CHUNK_MASK].reset();
+      }
+      setBit(column, column.active, position, false);
+      setBit(column, column.failures, position, true);
+      auto index = column.index(position);
+      if (index != DISCARDED) {
+        storeReach(column, index, position, reached);
+      }
+    }
+
+    /**
+     * Extends the reach of all entries at `position` to at least `reached`, for entries that
+     * depend on the result of an invocation that was still active when they were stored.
+     */
+    void extendReach(size_t position, size_t reached) {
+      if (!tracksReach) {
+        return;
+      }
+      for (auto &column : columns) {
+        auto index = column.index(position);
+        if (index < column.reach.size() && column.reach[index]) {
+          auto &distance = column.reach[index]->distances[position & CHUNK_MASK];
+          if (distance != UNBOUNDED && position + distance < reached) {
+            storeReach(column, index, position, reached);
+          }
+        }
+      }
+    }
+
+    /**
+     * Removes the entries of all rules at `position`, except for active invocations and the
+     * rules for which `keep` returns true.
+     */
+    template <class F> void invalidate(size_t position, const F &keep) {
+      for (std::uint32_t rule = 0; rule < columns.size(); ++rule) {
+        if (keep(rule)) {
+          continue;
+        }
+        auto &column = columns[rule];
+        auto index = column.index(position);
+        if (index < column.chunks.size() && column.chunks[index]) {
+          column.chunks[index]->trees[position & CHUNK_MASK].reset();
+        }
+        setBit(column, column.failures, position, false);
+      }
+    }
+
+    /**
+     * Removes all entries, keeping the allocated chunks for the next input. Only the chunks
+     * touched since the last call are visited.
+     */
+    void clear() {
+      for (auto &column : columns) {
+        column.offset = 0;
+        auto fillFront = [&column](Bits &bits) {
+          std::fill_n(bits.begin(), std::min(column.touched, bits.size()), 0);
+        };
+        fillFront(column.failures);
+        fillFront(column.active);
+        for (size_t index = 0; index < std::min(column.touched, column.chunks.size()); ++index) {
+          if (column.chunks[index]) {
+            for (auto &tree : column.chunks[index]->trees) {
+              tree.reset();
+            }
+          }
+        }
+        column.touched = 0;
+        column.reach.clear();
+      }
+    }
+
+    /** releases all chunks that only contain positions before `position` */
+    void discardBefore(size_t position) {
+      auto chunk = position >> CHUNK_BITS;
+      for (auto &column : columns) {
+        if (chunk <= column.offset) {
+          continue;
+        }
+        auto count = chunk - column.offset;
+        auto eraseFront = [count](auto &v) {
+          v.erase(v.begin(), v.begin() + std::min(count, v.size()));
+        };
+        eraseFront(column.failures);
+        eraseFront(column.active);
+        eraseFront(column.chunks);
+        eraseFront(column.reach);
+        column.touched -= std::min(count, column.touched);
+        column.offset = chunk;
+      }
+    }
+
+    /**
+     * Discards all chunks before `delta`, which must be a chunk boundary, and shifts the
+     * remaining positions by `delta`. The stored trees are not modified.
+     */
+    void rebase(size_t delta) {
+      discardBefore(delta);
+      for (auto &column : columns) {
+        column.offset -= delta >> CHUNK_BITS;
+      }
+    }
+
+    /**
+     * Adapts the table to an edit that replaced `deleted` positions at `offset` by `inserted`
+     * ones. Entries that may have read the edited range, i.e. up to `lookahead` positions beyond
+     * the furthest position they reached, are removed, the entries following the edit are moved.
+     * The stored trees are not modified. Requires a table that tracks the reach of its entries.
+     */
+    void applyEdit(size_t offset, size_t deleted, size_t inserted, size_t lookahead) {
+      auto end = offset + deleted;
+      for (auto &column : columns) {
+        // no invocation is active between parses
+        column.active.clear();
+        for (size_t index = 0; index < column.reach.size(); ++index) {
+          auto base = (column.offset + index) << CHUNK_BITS;
+          if (base >= end) {
+            break;
+          }
+          auto &reach = column.reach[index];
+          if (!reach || reach->furthest + lookahead <= offset) {
+            continue;
+          }
+          for (size_t i = 0; i < CHUNK_SIZE && base + i < end; ++i) {
+            auto distance = reach->distances[i];
+            if (distance == UNBOUNDED || base + i + distance + lookahead > offset) {
+              removeEntry(column, index, base + i);
+            }
+          }
+        }
+        if (inserted > deleted) {
+          for (auto index = column.reach.size(); index-- > 0;) {
+            moveEntries(column, index, end, inserted - deleted, true);
+          }
+        } else if (inserted < deleted) {
+          for (size_t index = 0; index < column.reach.size(); ++index) {
+            moveEntries(column, index, end, deleted - inserted, false);
+          }
+        }
+      }
+    }
+
+    /** calls `f` for every stored tree beginning at or after `from` */
+    template <class F> void forEachTree(const F &f, size_t from = 0) const {
+      for (auto &column : columns) {
+        for (size_t index = 0; index < column.chunks.size(); ++index) {
+          auto base = (column.offset + index) << CHUNK_BITS;
+          auto &chunk = column.chunks[index];
+          if (!chunk || base + CHUNK_SIZE <= from) {
+            continue;
+          }
+          for (size_t i = from > base ? from - base : 0; i < CHUNK_SIZE; ++i) {
+            if (chunk->trees[i]) {
+              f(chunk->trees[i]);
+            }
+          }
+        }
+      }
+    }
+
+  private:
+    static void removeEntry(Column &column, size_t index, size_t position) {
+      if (index < column.chunks.size() && column.chunks[index]) {
+        column.chunks[index]->trees[position & CHUNK_MASK].reset();
+      }
+      setBit(column, column.failures, position, false);
+    }
+
+    /** moves the entries of chunk `index` at or after `end` by `distance` */
+    void moveEntries(Column &column, size_t index, size_t end, size_t distance, bool forward) {
+      if (!column.reach[index]) {
+        return;
+      }
+      auto base = (column.offset + index) << CHUNK_BITS;
+      if (base + CHUNK_SIZE <= end) {
+        return;
+      }
+      auto chunk = index < column.chunks.size() ? column.chunks[index].get() : nullptr;
+      auto occupied = index < column.failures.size() ? column.failures[index] : 0;
+      if (chunk) {
+        for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+          occupied |= std::uint64_t(bool(chunk->trees[i])) << i;
+        }
+      }
+      if (base < end) {
+        occupied &= ~std::uint64_t(0) << (end - base);
+      }
+      if (!occupied) {
+        return;
+      }
+      auto failed = index < column.failures.size() ? column.failures[index] : 0;
+      if (index < column.failures.size()) {
+        column.failures[index] &= ~occupied;
+      }
+      auto distances = column.reach[index]->distances;
+      // move away from the entries that have not been moved yet
+      for (size_t n = 0; n < CHUNK_SIZE; ++n) {
+        auto i = forward ? CHUNK_SIZE - 1 - n : n;
+        if (!((occupied >> i) & 1)) {
+          continue;
+        }
+        auto position = base + i;
+        auto moved = forward ? position + distance : position - distance;
+        auto movedIndex = column.index(moved);
+        if (movedIndex == DISCARDED) {
+          if (chunk) {
+            chunk->trees[i].reset();
+          }
+          continue;
+        }
+        if (chunk && chunk->trees[i]) {
+          storeTree(column, movedIndex, moved, std::move(chunk->trees[i]));
+        } else if ((failed >> i) & 1) {
+          setBit(column, column.failures, moved, true);
+        }
+        auto &reach = reachAt(column, movedIndex);
+        reach.distances[moved & CHUNK_MASK] = distances[i];
+        reach.furthest = std::max(
+            reach.furthest, distances[i] == UNBOUNDED ? DISCARDED : moved + distances[i]);
+      }
+    }
+
+    static Reach &reachAt(Column &column, size_t index) {
+      if (index >= column.reach.size()) {
+        column.reach.resize(index + 1);
+      }
+      if (!column.reach[index]) {
+        column.reach[index].reset(new Reach());
+      }
+      return *column.reach[index];
+    }
+
+    static void storeTree(Column &column, size_t index, size_t position,
+                          std::shared_ptr<SyntaxTree> tree) {
+      if (index >= column.chunks.size()) {
+        column.chunks.resize(index + 1);
+      }
+      if (!column.chunks[index]) {
+        column.chunks[index].reset(new Chunk());
+      }
+      column.touched = std::max(column.touched, index + 1);
+      column.chunks[index]->trees[position & CHUNK_MASK] = std::move(tree);
+    }
+
+    void storeReach(Column &column, size_t index, size_t position, size_t reached) const {
+      if (!tracksReach) {
+        return;
+      }
+      auto &reach = reachAt(column, index);
+      auto distance = reached - position;
+      reach.distances[position & CHUNK_MASK]
+          = distance < UNBOUNDED ? std::uint32_t(distance) : UNBOUNDED;
+      reach.furthest = std::max(reach.furthest, reached);
+    }
+
+    static bool getBit(const Column &column, const Bits &bits, size_t position) {
+      auto index = column.index(position);
+      return index < bits.size() && (bits[index] >> (position & CHUNK_MASK)) & 1;
+    }
 
-  template <class Tuple> struct TupleHasher {
-    size_t operator()(Tuple const &tt) const {
-      size_t seed = 0;
-      HashValueImpl<Tuple>::apply(seed, tt);
-      return seed;
+    static void setBit(Column &column, Bits &bits, size_t position, bool value) {
+      auto index = column.index(position);
+      auto bit = std::uint64_t(1) << (position & CHUNK_MASK);
+      if (value) {
+        if (index == DISCARDED) {
+          return;
+        }
+        if (index >= bits.size()) {
+          bits.resize(index + 1, 0);
+        }
+        column.touched = std::max(column.touched, index + 1);
+        bits[index] |= bit;
+      } else if (index < bits.size()) {
+        bits[index] &= ~bit;
+      }
     }
   };
 
-  template <class T> std::string streamToString(T &&v) {
-    std::stringstream stream;
-    stream << v;
-    return stream.str();
-  }
+  /**
+   * Allocates syntax trees from a monotonic buffer. The trees refer to each other and to their
+   * rules without reference counting, destroying the arena only releases their child lists.
+   */
+  class TreeArena {
+  private:
+    struct Entry {
+      SyntaxTree tree;
+      Entry *previous;
+    };
+
+    std::pmr::monotonic_buffer_resource resource;
+    Entry *last = nullptr;
+
+  public:
+    explicit TreeArena(std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+        : resource(upstream) {}
+    TreeArena(const TreeArena &) = delete;
+    TreeArena &operator=(const TreeArena &) = delete;
+
+    ~TreeArena() {
+      while (last) {
+        auto entry = last;
+        last = entry->previous;
+        entry->~Entry();
+      }
+    }
+
+    SyntaxTree *create(grammar::Rule *rule, std::string_view string, size_t begin) {
+      // aliasing an empty pointer creates references without ownership or reference counting
+      last = new (resource.allocate(sizeof(Entry), alignof(Entry))) Entry{
+          SyntaxTree(std::shared_ptr<grammar::Rule>(std::shared_ptr<void>(), rule), string, begin),
+          last};
+      return &last->tree;
+    }
+  };
 
   class State {
   public:
@@ -93,15 +535,58 @@ namespace {
 
   private:
     size_t position;
-    using CacheKey = std::tuple<size_t, grammar::Rule *>;
-    using Cache = std::unordered_map<CacheKey, std::shared_ptr<SyntaxTree>, TupleHasher<CacheKey>>;
-    Cache cache;
-    std::shared_ptr<SyntaxTree> errorTree;
+    MemoTable cache;
 
   public:
-    size_t maxPosition;
+    /** the furthest position reached by the current rule invocation */
+    size_t reached;
+
+    /** if set, syntax trees are allocated from the arena and do not manage their lifetime */
+    TreeArena *arena;
+
+    /** if set, memo table accesses are counted per rule index */
+    std::vector<MemoizationProfile::Entry> *statistics = nullptr;
+
+    /** false while more input may be appended to `string` */
+    bool complete = true;
+
+    /** if unset, syntax trees refer to their rules without reference counting */
+    bool ownsRules = true;
+
+    /** starts at `c`, the memo table only holds the positions from the chunk containing `c` */
+    State(const std::string_view &s, size_t rules, TreeArena *a = nullptr,
+          size_t c = 0)
+        : string(s), position(c), cache(rules), reached(c), arena(a) {
+      if (c > 0) {
+        cache.discardBefore(c);
+      }
+    }
+
+    State(const std::string_view &s, MemoTable &&c)
+        : string(s), position(0), cache(std::move(c)), reached(0), arena(nullptr) {}
+
+    MemoTable releaseCache() { return std::move(cache); }
+
+    /** prepares parsing `s` from the start, reusing the memory of the memo table */
+    void reset(const std::string_view &s) {
+      string = s;
+      position = 0;
+      reached = 0;
+      cache.clear();
+    }
 
-    State(const std::string_view &s, size_t c = 0) : string(s), position(c), maxPosition(c) {}
+    std::shared_ptr<SyntaxTree> makeSyntaxTree(const std::shared_ptr<grammar::Rule> &rule,
+                                               size_t begin) {
+      if (!arena) {
+        if (!ownsRules) {
+          return std::make_shared<SyntaxTree>(
+              std::shared_ptr<grammar::Rule>(std::shared_ptr<void>(), rule.get()), string, begin);
+        }
+        return std::make_shared<SyntaxTree>(rule, string, begin);
+      }
+      return std::shared_ptr<SyntaxTree>(std::shared_ptr<void>(),
+                                         arena->create(rule.get(), string, begin));
+    }
 
     grammar::Letter current() { return position < string.size() ? string[position] : '\0'; }
 
@@ -110,8 +595,8 @@ namespace {
       if (position > string.size()) {
         position = string.size();
       }
-      if (position > maxPosition) {
-        maxPosition = position;
+      if (position > reached) {
+        reached = position;
       }
       PARSER_ADVANCE("advancing " << amount << " to " << position << ": '" << current() << "'");
     }
@@ -124,315 +609,1060 @@ namespace {
       PARSER_ADVANCE("resetting to " << position << ": '" << current() << "'");
     }
 
-    size_t getPosition() { return position; }
+    size_t getPosition() const { return position; }
 
-    struct Saved {
-      size_t position;
-      size_t innerCount;
-    };
+    bool isAtEnd() { return position == string.size(); }
 
-    Saved save() { return Saved{position, stack.size() > 0 ? stack.back()->inner.size() : 0}; }
+    /** true if the current instruction can only be decided once more input arrives */
+    bool needsInput() const { return !complete && position == string.size(); }
 
-    void load(const Saved &s) {
-      if (stack.size() > 0) {
-        stack.back()->end = getPosition();
-        stack.back()->inner.resize(s.innerCount);
-      }
-      setPosition(s.position);
+    /** true if `word` does not fit into the remaining input but may match once it continues */
+    bool needsInput(std::string_view word) const {
+      auto remaining = string.size() - position;
+      return !complete && remaining < word.size()
+             && string.substr(position) == word.substr(0, remaining);
     }
 
-    bool isAtEnd() { return position == string.size(); }
-
-    std::shared_ptr<SyntaxTree> getCached(const std::shared_ptr<grammar::Rule> &rule) {
-      auto it = cache.find(std::make_pair(position, rule.get()));
-      if (it != cache.end()) return it->second;
-      return std::shared_ptr<SyntaxTree>();
+    const std::shared_ptr<SyntaxTree> *getCached(std::uint32_t rule) const {
+      return cache.find(rule, position);
     }
 
-    void addToCache(const std::shared_ptr<SyntaxTree> &tree) {
-      cache[std::make_pair(tree->begin, tree->rule.get())] = tree;
-    }
+    bool hasFailed(std::uint32_t rule) const { return cache.hasFailed(rule, position); }
 
-    const Cache &getCache() { return cache; }
+    bool isActive(std::uint32_t rule) const { return cache.isActive(rule, position); }
 
-    void removeFromCache(const std::shared_ptr<SyntaxTree> &tree) {
-      auto it = cache.find(std::make_pair(tree->begin, tree->rule.get()));
-      if (it != cache.end()) {
-        cache.erase(it);
+    void countInvocation(std::uint32_t rule) {
+      if (statistics) {
+        (*statistics)[rule].invocations++;
       }
     }
 
-    void addInnerSyntaxTree(const std::shared_ptr<SyntaxTree> &tree) {
-      if (stack.size() > 0 && !tree->rule->hidden) {
-        stack.back()->inner.push_back(tree);
+    void countHit(std::uint32_t rule) {
+      if (statistics) {
+        (*statistics)[rule].hits++;
       }
     }
 
-    std::vector<std::shared_ptr<SyntaxTree>> stack;
+    void addActiveToCache(std::uint32_t rule) { cache.storeActive(rule, position); }
 
-    std::shared_ptr<SyntaxTree> getErrorTree() { return errorTree; }
+    /** includes the input read by the cached invocation of `rule` in the current invocation */
+    void reachCached(std::uint32_t rule) {
+      reached = std::max(reached, cache.getReached(rule, position, string.size()));
+    }
 
-    void trackError(const std::shared_ptr<SyntaxTree> &tree) {
-      if (!tree) {
-        return;
-      }
-      if (tree->length() > 0 && !tree->rule->hidden) {
-        if (errorTree) {
-          if (tree->end >= errorTree->end) {
-            errorTree = tree;
-          }
-        } else {
-          errorTree = tree;
-        }
-      }
+    void addToCache(std::uint32_t rule, const std::shared_ptr<SyntaxTree> &tree) {
+      cache.store(rule, tree, reached);
     }
-  };
 
-  bool parse(const std::shared_ptr<grammar::Node> &node, State &state);
+    void addFailureToCache(std::uint32_t rule, size_t p) { cache.storeFailure(rule, p, reached); }
 
-  std::shared_ptr<SyntaxTree> parseRule(const std::shared_ptr<grammar::Rule> &rule, State &state,
-                                        bool useCache = true) {
-    PARSER_TRACE("enter rule " << rule->name);
-    INCREASE_INDENT;
+    /** includes the input read by the current invocation in the reach of all entries at `p` */
+    void extendCachedReach(size_t p) { cache.extendReach(p, reached); }
 
-    if (useCache && rule->cacheable) {
-      auto cached = state.getCached(rule);
+    /** removes cached results at position `p`, see `MemoTable::invalidate` */
+    template <class F> void invalidateCache(size_t p, const F &keep) { cache.invalidate(p, keep); }
 
-      if (cached) {
-        PARSER_TRACE("cached");
-        if (cached->valid) {
-          state.addInnerSyntaxTree(cached);
-          state.advance();
-          state.setPosition(cached->end);
-        } else {
-          PARSER_TRACE("failed");
-          if (cached->active && !cached->recursive) {
-            PARSER_TRACE("found left recursion");
-            cached->recursive = true;
-          }
-        }
-        DECREASE_INDENT;
-        PARSER_TRACE("exit rule " << rule->name);
-        return cached;
-      }
-    }
+    void discardCacheBefore(size_t p) { cache.discardBefore(p); }
 
-    auto syntaxTree = std::make_shared<SyntaxTree>(rule, state.string, state.getPosition());
+    template <class F> void forEachCached(const F &f) const { cache.forEachTree(f); }
 
-    if (useCache) {
-      state.addToCache(syntaxTree);
+    /** shifts all positions by `delta` after the input before it has been released */
+    void rebase(size_t delta) {
+      cache.rebase(delta);
+      position -= delta;
+      reached -= std::min(reached, delta);
     }
+  };
 
-    auto saved = state.save();
-    state.stack.push_back(syntaxTree);
-    syntaxTree->valid = parse(rule->node, state);
-    syntaxTree->end = state.getPosition();
-    syntaxTree->active = false;
-    state.stack.pop_back();
+  /**
+   * Executes a compiled grammar. Instead of recursing through the grammar graph, the machine
+   * keeps rule invocations and backtrack entries on explicit stacks, so the nesting depth of the
+   * input is only limited by the available heap memory.
+   *
+   * Syntax trees are only created for successful rule invocations. Until then, the children of
+   * all active invocations are collected on a shared stack, failed attempts leave nothing behind
+   * but a bit in the memo table.
+   *
+   * If the input is incomplete, instructions that reach its end suspend the machine. Running it
+   * again after input has been appended resumes at the suspended instruction.
+   */
+  class Machine {
+  private:
+    using Opcode = bytecode::Instruction::Opcode;
 
-    if (syntaxTree->valid) {
-      if (useCache && syntaxTree->recursive) {
-        PARSER_TRACE("enter left recursion: " << rule->name);
-        while (true) {
-          State recursionState(state.string, syntaxTree->begin);
-          recursionState.trackError(state.getErrorTree());
-          // Copy the cache except the currect position to the recursion state
-          // TODO: keeping the current state and modifying the cache in place is
-          // probably much more efficient.
-          for (auto &cached : state.getCache()) {
-            if (std::get<0>(cached.first) != syntaxTree->begin) {
-              recursionState.addToCache(cached.second);
-            }
-          }
-          recursionState.addToCache(syntaxTree);
-          auto tmp = parseRule(rule, recursionState, false);
-          state.trackError(recursionState.getErrorTree());
-          if (tmp->valid && tmp->end > syntaxTree->end) {
-            PARSER_TRACE("parsed left recursion");
-            syntaxTree = tmp;
-            if (useCache) {
-              state.addToCache(syntaxTree);
-            }
-            state.setPosition(tmp->end);
-          } else {
-            break;
-          }
-        }
-        PARSER_TRACE("exit left recursion");
-      }
+    static constexpr std::uint32_t CALL_FRAME = std::numeric_limits<std::uint32_t>::max();
+    /** marks the entry of a choice that has been committed to by a cut */
+    static constexpr std::uint32_t DISCARDED = CALL_FRAME - 1;
 
-      state.addInnerSyntaxTree(syntaxTree);
-    } else {
-      state.trackError(syntaxTree);
-      state.load(saved);
-    }
+    /** a point to resume parsing after a failure, or the start of a rule invocation */
+    struct Backtrack {
+      std::uint32_t alternative;
+      size_t position;
+      size_t innerCount;
+    };
 
-    DECREASE_INDENT;
-    PARSER_TRACE("exit rule " << rule->name);
+    struct Call {
+      /** the tree exposed to filters, only created once a filter is reached */
+      std::shared_ptr<SyntaxTree> tree;
+      /** the longest match of a left-recursive rule found so far */
+      std::shared_ptr<SyntaxTree> seed;
+      size_t begin;
+      /** the index of the invocation's first child in `Machine::inner` */
+      size_t innerBegin;
+      /** `State::reached` of the calling invocation */
+      size_t outerReached;
+      std::uint32_t rule;
+      std::uint32_t returnAddress;
+      bool recursive;
+    };
 
-    return syntaxTree;
-  }
+    /** a failed invocation, see `Parser::Result::error` */
+    struct Failure {
+      std::uint32_t rule;
+      size_t begin;
+      /** the furthest position the invocation has reached */
+      size_t end;
+    };
 
-  bool parse(const std::shared_ptr<grammar::Node> &node, State &state) {
-    using Node = peg_parser::grammar::Node;
-    using Symbol = Node::Symbol;
+    const bytecode::Program &program;
+    State &state;
+    std::vector<Backtrack> backtrack;
+    std::vector<Call> calls;
+    std::vector<std::shared_ptr<SyntaxTree>> inner;
+    std::shared_ptr<SyntaxTree> result;
+    std::uint32_t resumeAddress = 0;
+    /** the visible invocation that has failed furthest into the input */
+    std::optional<Failure> furthestFailure;
+
+    Backtrack save(std::uint32_t alternative) {
+      return Backtrack{alternative, state.getPosition(), inner.size()};
+    }
 
-    PARSER_TRACE("parsing " << *node);
+    void load(const Backtrack &saved) {
+      inner.resize(saved.innerCount);
+      if (reducer) {
+        reducer->truncate(saved.innerCount);
+      }
+      state.setPosition(saved.position);
+    }
 
-    auto c = state.current();
-    switch (node->symbol) {
-      case peg_parser::grammar::Node::Symbol::WORD: {
-        auto saved = state.save();
-        for (auto c : pget<std::string>(node->data)) {
-          if (state.current() != c) {
-            state.load(saved);
-            PARSER_TRACE("failed");
-            return false;
-          }
-          state.advance();
+    /** `reduced` is set if the value of `tree` is already the last one of the reducer */
+    void addInnerSyntaxTree(std::uint32_t index, const std::shared_ptr<SyntaxTree> &tree,
+                            bool reduced = false) {
+      if (program.rules[index].hidden) {
+        return;
+      }
+      if (reducer) {
+        // only the reducer's stack holds the children while reducing
+        inner.emplace_back();
+        if (!reduced) {
+          reducer->recall(*tree);
         }
-        return true;
+      } else {
+        inner.push_back(tree);
+      }
+    }
+
+    /** replaces the children of the current invocation by its value, see `Parser::Reducer` */
+    void reduceChildren(const Call &call) {
+      auto &entry = program.rules[call.rule];
+      if (entry.hidden) {
+        reducer->truncate(call.innerBegin);
+      } else {
+        reducer->reduce(entry.rule, call.begin, state.getPosition(),
+                        inner.size() - call.innerBegin);
       }
+      inner.resize(call.innerBegin);
+    }
 
-      case peg_parser::grammar::Node::Symbol::ANY: {
-        if (state.isAtEnd()) {
-          PARSER_TRACE("failed");
-          return false;
-        } else {
-          state.advance();
-          return true;
+    /**
+     * Creates the tree of the current invocation, moving its children from the shared stack.
+     * While reducing, the tree has no children and the invocation's value is left as the last
+     * value of the reducer, one past the shared stack.
+     */
+    std::shared_ptr<SyntaxTree> materialize(Call &call) {
+      auto tree = std::move(call.tree);
+      if (!tree) {
+        tree = state.makeSyntaxTree(program.rules[call.rule].rule, call.begin);
+      }
+      if (reducer) {
+        reduceChildren(call);
+        if (!program.rules[call.rule].hidden) {
+          reducer->memoize(*tree);
         }
+      } else {
+        auto first = inner.begin() + call.innerBegin;
+        tree->inner.assign(std::make_move_iterator(first), std::make_move_iterator(inner.end()));
+        inner.erase(first, inner.end());
       }
+      tree->end = state.getPosition();
+      tree->valid = true;
+      tree->active = false;
+      tree->recursive = call.recursive;
+      return tree;
+    }
 
-      case Symbol::RANGE: {
-        auto &v = pget<std::array<grammar::Letter, 2>>(node->data);
-        if (c >= v[0] && c <= v[1]) {
-          state.advance();
-          return true;
-        } else {
-          PARSER_TRACE("failed");
-          return false;
+    /** marks the active invocation of `index` at the current position as left-recursive */
+    void setRecursive(std::uint32_t index) {
+      auto position = state.getPosition();
+      for (auto it = calls.rbegin(); it != calls.rend() && it->begin == position; ++it) {
+        if (it->rule == index) {
+          PARSER_TRACE("found left recursion");
+          it->recursive = true;
+          return;
         }
       }
+    }
 
-      case Symbol::SEQUENCE: {
-        auto saved = state.save();
-        for (auto n : pget<std::vector<grammar::Node::Shared>>(node->data)) {
-          if (!parse(n, state)) {
-            state.load(saved);
-            return false;
-          }
-        }
-        return true;
+    std::uint32_t enterRule(std::uint32_t index, std::uint32_t returnAddress) {
+      auto &rule = program.rules[index];
+      if (rule.memoize) {
+        state.addActiveToCache(index);
       }
+      backtrack.push_back(save(CALL_FRAME));
+      calls.push_back(Call{nullptr, nullptr, state.getPosition(), inner.size(), state.reached,
+                           index, returnAddress, false});
+      state.reached = state.getPosition();
+      return rule.entry;
+    }
 
-      case Symbol::CHOICE: {
-        for (auto n : pget<std::vector<grammar::Node::Shared>>(node->data)) {
-          if (parse(n, state)) {
+    /**
+     * Starts another attempt to extend the seed of the current left-recursive rule. Results at
+     * the seed's position may depend on the previous seed and are invalidated, except for active
+     * invocations and the seeds of enclosing left-recursive rules at the same position.
+     */
+    std::uint32_t growSeed() {
+      auto &call = calls.back();
+      auto begin = call.begin;
+      state.invalidateCache(begin, [&](std::uint32_t index) {
+        for (auto it = calls.rbegin(); it != calls.rend() && it->begin == begin; ++it) {
+          if (it->seed && it->rule == index) {
             return true;
           }
         }
         return false;
-      }
+      });
+      state.addToCache(call.rule, call.seed);
+      state.setPosition(begin);
+      backtrack.push_back(Backtrack{CALL_FRAME, begin, inner.size()});
+      return program.rules[call.rule].entry;
+    }
 
-      case Symbol::ZERO_OR_MORE: {
-        auto data = pget<Node::Shared>(node->data);
-        while (parse(data, state)) {
-        }
-        return true;
+    /**
+     * Leaves the current left-recursive rule with its seed. The seed is memoized again, as the
+     * failed attempt to grow it may have read further than all previous attempts.
+     */
+    std::uint32_t exitRecursion() {
+      PARSER_TRACE("exit left recursion");
+      auto &call = calls.back();
+      state.setPosition(call.seed->end);
+      state.addToCache(call.rule, call.seed);
+      return exitRule(call.seed);
+    }
+
+    std::uint32_t exitRule(std::shared_ptr<SyntaxTree> tree, bool reduced = false) {
+      DECREASE_INDENT;
+      PARSER_TRACE("exit rule " << tree->rule->name);
+      auto returnAddress = calls.back().returnAddress;
+      auto index = calls.back().rule;
+      state.reached = std::max(state.reached, calls.back().outerReached);
+      calls.pop_back();
+      if (calls.empty()) {
+        result = std::move(tree);
+      } else {
+        addInnerSyntaxTree(index, tree, reduced);
       }
+      return returnAddress;
+    }
 
-      case peg_parser::grammar::Node::Symbol::ONE_OR_MORE: {
-        const auto &data = pget<Node::Shared>(node->data);
-        if (!parse(data, state)) {
-          return false;
-        }
-        while (parse(data, state)) {
-        }
-        return true;
+    /** leaves an invocation that has been reduced without a tree, its value is already pushed */
+    std::uint32_t exitReduced() {
+      DECREASE_INDENT;
+      auto &call = calls.back();
+      PARSER_TRACE("exit rule " << program.rules[call.rule].rule->name);
+      auto returnAddress = call.returnAddress;
+      state.reached = std::max(state.reached, call.outerReached);
+      if (!program.rules[call.rule].hidden) {
+        inner.emplace_back();
       }
+      calls.pop_back();
+      return returnAddress;
+    }
 
-      case peg_parser::grammar::Node::Symbol::OPTIONAL: {
-        const auto &data = pget<Node::Shared>(node->data);
-        parse(data, state);
-        return true;
+    std::uint32_t returnFromRule() {
+      backtrack.pop_back();
+      auto &call = calls.back();
+      if (reducer && !call.seed && !call.recursive && calls.size() > 1
+          && !program.rules[call.rule].memoize) {
+        reduceChildren(call);
+        return exitReduced();
+      }
+      auto tree = materialize(call);
+      if (reducer && (call.seed || call.recursive)) {
+        // seeds are recalled from the reducer's side table
+        reducer->truncate(call.innerBegin);
       }
 
-      case peg_parser::grammar::Node::Symbol::ALSO: {
-        const auto &data = pget<Node::Shared>(node->data);
-        auto saved = state.save();
-        auto result = parse(data, state);
-        state.load(saved);
-        return result;
+      if (call.seed) {
+        if (tree->end > call.seed->end) {
+          PARSER_TRACE("parsed left recursion");
+          call.seed = tree;
+          return growSeed();
+        }
+        return exitRecursion();
       }
 
-      case peg_parser::grammar::Node::Symbol::NOT: {
-        const auto &data = pget<Node::Shared>(node->data);
-        auto saved = state.save();
-        auto result = parse(data, state);
-        state.load(saved);
-        return !result;
+      if (call.recursive) {
+        PARSER_TRACE("enter left recursion: " << tree->rule->name);
+        call.seed = tree;
+        return growSeed();
       }
 
-      case peg_parser::grammar::Node::Symbol::ERROR: {
-        return false;
+      if (program.rules[call.rule].memoize) {
+        state.addToCache(call.rule, tree);
       }
+      return exitRule(tree, true);
+    }
 
-      case peg_parser::grammar::Node::Symbol::EMPTY: {
-        return true;
+    /** true if failures at `position` are at least as far as the furthest recorded ones */
+    bool isFurthestFailure(size_t position) const {
+      if (position > diagnosis->position) {
+        diagnosis->position = position;
+        diagnosis->rules.clear();
+        diagnosis->terminals.clear();
       }
+      return position == diagnosis->position;
+    }
 
-      case peg_parser::grammar::Node::Symbol::RULE: {
-        const auto &rule = pget<std::shared_ptr<grammar::Rule>>(node->data);
-        return parseRule(rule, state)->valid;
+    void addExpected(std::string terminal) const {
+      auto &terminals = diagnosis->terminals;
+      if (std::find(terminals.begin(), terminals.end(), terminal) == terminals.end()) {
+        terminals.push_back(std::move(terminal));
       }
+    }
 
-      case peg_parser::grammar::Node::Symbol::WEAK_RULE: {
-        const auto &data = pget<std::weak_ptr<grammar::Rule>>(node->data);
-        if (auto rule = data.lock()) {
-          return parseRule(rule, state)->valid;
-        } else {
-          throw Parser::GrammarError(Parser::GrammarError::INVALID_RULE, node);
-        }
+    void addExpectedRule(std::uint32_t index, size_t position) const {
+      auto &entry = program.rules[index];
+      auto &rules = diagnosis->rules;
+      if (!entry.hidden && isFurthestFailure(position)
+          && std::find(rules.begin(), rules.end(), entry.rule) == rules.end()) {
+        rules.push_back(entry.rule);
       }
+    }
 
-      case peg_parser::grammar::Node::Symbol::END_OF_FILE: {
-        auto res = state.isAtEnd();
-        if (!res) {
-          PARSER_TRACE("failed");
+    /** records the terminal of the failed `instruction`, terminals of hidden rules are ignored */
+    void recordFailure(const bytecode::Instruction &instruction) const {
+      if (instruction.opcode == Opcode::CALL) {
+        if (state.hasFailed(instruction.argument)) {
+          addExpectedRule(instruction.argument, state.getPosition());
         }
-        return res;
+        return;
       }
-
-      case peg_parser::grammar::Node::Symbol::FILTER: {
-        const auto &callback = pget<grammar::Node::FilterCallback>(node->data);
-        bool res;
-        if (state.stack.size() > 0) {
-          auto tree = state.stack.back();
-          tree->end = state.getPosition();
-          res = callback(tree);
-          state.setPosition(tree->end);
-        } else {
-          res = false;
+      if (instruction.opcode == Opcode::FILTER || instruction.opcode == Opcode::FAIL
+          || instruction.opcode == Opcode::FAIL_TWICE
+          || (!calls.empty() && program.rules[calls.back().rule].hidden)
+          || !isFurthestFailure(state.getPosition())) {
+        return;
+      }
+      switch (instruction.opcode) {
+        case Opcode::WORD: {
+          addExpected("'" + program.words[instruction.argument] + "'");
+          break;
+        }
+        case Opcode::ANY: {
+          addExpected("any character");
+          break;
+        }
+        case Opcode::RANGE: {
+          addExpected(describeCharacters(
+              [&](size_t c) { return char(c) >= instruction.from && char(c) <= instruction.to; }));
+          break;
+        }
+        case Opcode::SET: {
+          auto &characters = program.characterClasses[instruction.argument];
+          addExpected(describeCharacters([&](size_t c) { return characters.contains(char(c)); }));
+          break;
         }
-        if (!res) {
-          PARSER_TRACE("failed");
+        case Opcode::KEYWORDS: {
+          for (auto &keyword : program.keywordTables[instruction.argument].getKeywords()) {
+            addExpected("'" + keyword + "'");
+          }
+          break;
+        }
+        case Opcode::END_OF_FILE: {
+          addExpected("end of input");
+          break;
         }
-        return res;
+        default:
+          break;
       }
     }
 
-    throw Parser::GrammarError(Parser::GrammarError::UNKNOWN_SYMBOL, node);
-  }
+    /** unwinds the stacks to the last backtrack entry, returns false if there is none */
+    bool fail(std::uint32_t &pc) {
+      PARSER_TRACE("failed");
+      while (!backtrack.empty()) {
+        auto saved = backtrack.back();
+        backtrack.pop_back();
 
-}  // namespace
+        if (saved.alternative == DISCARDED) {
+          continue;
+        }
 
-SyntaxTree::SyntaxTree(const std::shared_ptr<grammar::Rule> &r, std::string_view s, size_t p)
-    : rule(r), fullString(s), begin(p), end(p), valid(false), active(true) {}
+        if (saved.alternative != CALL_FRAME) {
+          load(saved);
+          pc = saved.alternative;
+          return true;
+        }
 
-const char *peg_parser::Parser::GrammarError::what() const noexcept {
-  if (buffer.size() == 0) {
-    std::string typeName;
+        auto &call = calls.back();
+        if (call.seed) {
+          // the seed cannot be grown any further
+          load(saved);
+          pc = exitRecursion();
+          return true;
+        }
+
+        if (program.rules[call.rule].memoize) {
+          if (call.recursive) {
+            // invocations at the same position may have failed because this one was active
+            state.extendCachedReach(call.begin);
+          }
+          state.addFailureToCache(call.rule, call.begin);
+        }
+        if (diagnosis) {
+          addExpectedRule(call.rule, call.begin);
+        }
+        if (!program.rules[call.rule].hidden && state.reached > call.begin
+            && (!furthestFailure || state.reached >= furthestFailure->end)) {
+          furthestFailure = Failure{call.rule, call.begin, state.reached};
+        }
+        DECREASE_INDENT;
+        PARSER_TRACE("exit rule " << program.rules[call.rule].rule->name);
+        load(saved);
+        if (calls.size() == 1) {
+          // the failed start rule is the only failure that is returned as a syntax tree
+          result = std::move(call.tree);
+          if (!result) {
+            result = state.makeSyntaxTree(program.rules[call.rule].rule, call.begin);
+          }
+          result->inner.clear();
+          result->end = call.begin;
+          result->valid = false;
+          result->active = false;
+        }
+        state.reached = std::max(state.reached, call.outerReached);
+        calls.pop_back();
+      }
+      return false;
+    }
+
+    /**
+     * Discards the memo table before the first position the parser may still return to: the
+     * resume positions of all remaining alternatives and the seeds of left-recursive rules.
+     */
+    void discardUnreachableCache() {
+      auto bound = state.getPosition();
+      for (auto &saved : backtrack) {
+        if (saved.alternative != CALL_FRAME && saved.alternative != DISCARDED) {
+          bound = std::min(bound, saved.position);
+        }
+      }
+      for (auto &call : calls) {
+        if (call.seed) {
+          bound = std::min(bound, call.begin);
+        }
+      }
+      state.discardCacheBefore(bound);
+    }
+
+    std::shared_ptr<SyntaxTree> suspend(std::uint32_t pc) {
+      resumeAddress = pc;
+      return nullptr;
+    }
+
+  public:
+    /** if set, receives the committed children of the start rule, see `PushParser` */
+    const PushParser::ItemCallback *onItem = nullptr;
+
+    /** set if the input may move between runs, trees are then updated before they are exposed */
+    bool relocatable = false;
+
+    /** if set, the furthest failures are recorded, see `Parser::diagnose` */
+    Parser::Diagnosis *diagnosis = nullptr;
+
+    /** if set, replaces the children of rule invocations by values, see `Parser::Reducer` */
+    Parser::Reducer *reducer = nullptr;
+
+    Machine(const bytecode::Program &p, State &s) : program(p), state(s) {}
+
+    /** prepares parsing from the start, keeping the capacity of the stacks */
+    void reset() {
+      backtrack.clear();
+      calls.clear();
+      inner.clear();
+      result.reset();
+      resumeAddress = 0;
+      furthestFailure.reset();
+    }
+
+    /**
+     * The result of a completed run with the tree of its furthest failure, which has no
+     * children and ends at the furthest position the failed invocation has reached.
+     */
+    Parser::Result getResult(const std::shared_ptr<SyntaxTree> &syntax) const {
+      if (!furthestFailure) {
+        return Parser::Result{syntax, syntax, nullptr, nullptr};
+      }
+      auto error
+          = state.makeSyntaxTree(program.rules[furthestFailure->rule].rule, furthestFailure->begin);
+      error->end = furthestFailure->end;
+      error->valid = false;
+      error->active = false;
+      return Parser::Result{syntax, error, nullptr, nullptr};
+    }
+
+    /** parses rule `index` at the current position instead of the start rule */
+    std::shared_ptr<SyntaxTree> runRule(std::uint32_t index) {
+      // the start rule's call is followed by the program's `END` instruction
+      resumeAddress = enterRule(index, 1);
+      return run();
+    }
+
+    /** points `tree` and its descendants to the current input */
+    void refreshStrings(const std::shared_ptr<SyntaxTree> &tree) const {
+      std::vector<SyntaxTree *> pending{tree.get()};
+      while (!pending.empty()) {
+        auto current = pending.back();
+        pending.pop_back();
+        current->fullString = state.string;
+        for (auto &child : current->inner) {
+          pending.push_back(child.get());
+        }
+      }
+    }
+
+    /**
+     * Passes the children of the start rule that no remaining alternative can discard to
+     * `onItem` and removes them from the shared stack.
+     */
+    void emitCommittedItems() {
+      if (!onItem || calls.empty()) {
+        return;
+      }
+      auto count = calls.size() > 1 ? calls[1].innerBegin : inner.size();
+      for (auto &saved : backtrack) {
+        if (saved.alternative != CALL_FRAME && saved.alternative != DISCARDED) {
+          count = std::min(count, saved.innerCount);
+        }
+      }
+      if (count == 0) {
+        return;
+      }
+      for (size_t i = 0; i < count; ++i) {
+        refreshStrings(inner[i]);
+        (*onItem)(inner[i]);
+      }
+      inner.erase(inner.begin(), inner.begin() + count);
+      for (auto &saved : backtrack) {
+        saved.innerCount -= std::min(saved.innerCount, count);
+      }
+      for (auto &call : calls) {
+        call.innerBegin -= std::min(call.innerBegin, count);
+      }
+    }
+
+    /**
+     * The first position of the input that may still be read or referenced by a syntax tree,
+     * rounded down to a memo table chunk. The start rule's invocation is not taken into account.
+     */
+    size_t getRetainedPosition() const {
+      auto bound = state.getPosition();
+      for (auto &saved : backtrack) {
+        if (saved.alternative != CALL_FRAME && saved.alternative != DISCARDED) {
+          bound = std::min(bound, saved.position);
+        }
+      }
+      for (size_t i = 0; i < calls.size(); ++i) {
+        if (i > 0 || calls[i].seed) {
+          bound = std::min(bound, calls[i].begin);
+        }
+      }
+      if (!inner.empty()) {
+        // children of the start rule are ordered, the others begin after their invocation
+        bound = std::min(bound, inner.front()->begin);
+      }
+      return MemoTable::chunkBegin(bound);
+    }
+
+    /**
+     * Shifts all positions by `delta` after the input before `getRetainedPosition()` has been
+     * released. Positions of the start rule's invocation are clamped to the new beginning.
+     */
+    void rebase(size_t delta) {
+      std::unordered_set<SyntaxTree *> visited;
+      std::vector<SyntaxTree *> pending;
+      auto add = [&](const std::shared_ptr<SyntaxTree> &tree) {
+        if (tree && visited.insert(tree.get()).second) {
+          pending.push_back(tree.get());
+        }
+      };
+      state.rebase(delta);
+      for (auto &tree : inner) {
+        add(tree);
+      }
+      for (auto &call : calls) {
+        add(call.tree);
+        add(call.seed);
+        call.begin -= std::min(call.begin, delta);
+        call.outerReached -= std::min(call.outerReached, delta);
+      }
+      state.forEachCached(add);
+      while (!pending.empty()) {
+        auto tree = pending.back();
+        pending.pop_back();
+        tree->begin -= std::min(tree->begin, delta);
+        tree->end -= std::min(tree->end, delta);
+        for (auto &child : tree->inner) {
+          add(child);
+        }
+      }
+      for (auto &saved : backtrack) {
+        saved.position -= std::min(saved.position, delta);
+      }
+      if (furthestFailure) {
+        furthestFailure->begin -= std::min(furthestFailure->begin, delta);
+        furthestFailure->end -= std::min(furthestFailure->end, delta);
+      }
+    }
+
+    /** runs until the parse is complete, returns `nullptr` if the machine has been suspended */
+    std::shared_ptr<SyntaxTree> run() {
+      auto pc = resumeAddress;
+
+      while (true) {
+        const auto &instruction = program.instructions[pc];
+        bool success = true;
+
+        switch (instruction.opcode) {
+          case Opcode::WORD: {
+            const auto &word = program.words[instruction.argument];
+            if (state.string.compare(state.getPosition(), word.size(), word) == 0) {
+              state.advance(word.size());
+              ++pc;
+            } else if (state.needsInput(word)) {
+              return suspend(pc);
+            } else {
+              success = false;
+            }
+            break;
+          }
+
+          case Opcode::ANY: {
+            if (state.needsInput()) {
+              return suspend(pc);
+            }
+            if (state.isAtEnd()) {
+              success = false;
+            } else {
+              state.advance();
+              ++pc;
+            }
+            break;
+          }
+
+          case Opcode::RANGE: {
+            if (state.needsInput()) {
+              return suspend(pc);
+            }
+            auto c = state.current();
+            if (!state.isAtEnd() && c >= instruction.from && c <= instruction.to) {
+              state.advance();
+              ++pc;
+            } else {
+              success = false;
+            }
+            break;
+          }
+
+          case Opcode::SET: {
+            if (state.needsInput()) {
+              return suspend(pc);
+            }
+            if (!state.isAtEnd()
+                && program.characterClasses[instruction.argument].contains(state.current())) {
+              state.advance();
+              ++pc;
+            } else {
+              success = false;
+            }
+            break;
+          }
+
+          case Opcode::SPAN: {
+            auto position = state.getPosition();
+            auto end = program.characterClasses[instruction.argument].span(state.string, position);
+            state.advance(end - position);
+            if (state.needsInput()) {
+              // the span continues from here once more input arrives
+              return suspend(pc);
+            }
+            ++pc;
+            break;
+          }
+
+          case Opcode::KEYWORDS: {
+            const auto &keywords = program.keywordTables[instruction.argument];
+            auto length = keywords.match(state.string, state.getPosition(), state.complete);
+            if (length == bytecode::KeywordTable::NEEDS_INPUT) {
+              return suspend(pc);
+            }
+            if (length == bytecode::KeywordTable::NO_MATCH) {
+              success = false;
+            } else {
+              state.advance(length);
+              ++pc;
+            }
+            break;
+          }
+
+          case Opcode::CUT: {
+            // only the first cut of an alternative commits anything
+            bool committed = true;
+            if (instruction.argument != bytecode::Instruction::NO_CUT_TARGET) {
+              auto &entry = backtrack[backtrack.size() - 1 - instruction.argument];
+              committed = entry.alternative != DISCARDED;
+              entry.alternative = DISCARDED;
+            }
+            if (committed) {
+              discardUnreachableCache();
+              emitCommittedItems();
+            }
+            ++pc;
+            break;
+          }
+
+          case Opcode::SCAN: {
+            auto position = state.getPosition();
+            const auto &word = program.words[instruction.argument];
+            auto end = findWord(state.string, position, word);
+            if (end == state.string.size() && !state.complete) {
+              // a delimiter may start within the last `word.size() - 1` bytes
+              end = std::max(position, end - std::min(end, word.size() - 1));
+              state.advance(end - position);
+              return suspend(pc);
+            }
+            state.advance(end - position);
+            ++pc;
+            break;
+          }
+
+          case Opcode::END_OF_FILE: {
+            if (state.needsInput()) {
+              return suspend(pc);
+            }
+            success = state.isAtEnd();
+            ++pc;
+            break;
+          }
+
+          case Opcode::FILTER: {
+            if (calls.empty()) {
+              success = false;
+              break;
+            }
+            auto &call = calls.back();
+            if (!call.tree) {
+              call.tree = state.makeSyntaxTree(program.rules[call.rule].rule, call.begin);
+            }
+            const auto &tree = call.tree;
+            if (!reducer) {
+              tree->inner.assign(inner.begin() + call.innerBegin, inner.end());
+            }
+            tree->end = state.getPosition();
+            if (relocatable) {
+              refreshStrings(tree);
+            }
+            success = program.filters[instruction.argument](tree);
+            state.setPosition(tree->end);
+            state.reached = std::max(state.reached, tree->end);
+            ++pc;
+            break;
+          }
+
+          case Opcode::CALL: {
+            auto index = instruction.argument;
+            PARSER_TRACE("enter rule " << program.rules[index].rule->name);
+            INCREASE_INDENT;
+            state.countInvocation(index);
+            // the start rule is always invoked to produce the result, even if it is memoized
+            if (program.rules[index].memoize && !calls.empty()) {
+              if (state.hasFailed(index)) {
+                PARSER_TRACE("cached");
+                DECREASE_INDENT;
+                state.countHit(index);
+                state.reachCached(index);
+                success = false;
+                break;
+              }
+              if (state.isActive(index)) {
+                DECREASE_INDENT;
+                setRecursive(index);
+                success = false;
+                break;
+              }
+              if (auto cached = state.getCached(index)) {
+                PARSER_TRACE("cached");
+                DECREASE_INDENT;
+                state.countHit(index);
+                state.reachCached(index);
+                auto end = (*cached)->end;
+                addInnerSyntaxTree(index, *cached);
+                state.setPosition(end);
+                ++pc;
+                break;
+              }
+            }
+            pc = enterRule(index, pc + 1);
+            break;
+          }
+
+          case Opcode::SELECT: {
+            if (state.needsInput()) {
+              return suspend(pc);
+            }
+            const auto &table = program.dispatchTables[instruction.argument];
+            auto target = state.isAtEnd()
+                              ? table.targets[bytecode::DispatchTable::END_OF_INPUT]
+                              : table.targets[static_cast<unsigned char>(state.current())];
+            if (target == bytecode::DispatchTable::NO_ALTERNATIVE) {
+              if (diagnosis) {
+                // tries all alternatives in order, recording each failed terminal
+                ++pc;
+                break;
+              }
+              success = false;
+            } else {
+              pc = target;
+            }
+            break;
+          }
+
+          case Opcode::RETURN: {
+            pc = returnFromRule();
+            break;
+          }
+
+          case Opcode::CHOICE: {
+            backtrack.push_back(save(instruction.argument));
+            ++pc;
+            break;
+          }
+
+          case Opcode::COMMIT: {
+            backtrack.pop_back();
+            pc = instruction.argument;
+            break;
+          }
+
+          case Opcode::PARTIAL_COMMIT: {
+            // the repetition ends after this instruction
+            auto &saved = backtrack.back();
+            if (saved.position == state.getPosition()) {
+              // the repetition did not consume any input and would repeat forever
+              ++pc;
+              backtrack.pop_back();
+            } else {
+              saved.position = state.getPosition();
+              saved.innerCount = inner.size();
+              // a cut only commits the iteration it is part of
+              saved.alternative = pc + 1;
+              pc = instruction.argument;
+            }
+            break;
+          }
+
+          case Opcode::BACK_COMMIT: {
+            load(backtrack.back());
+            backtrack.pop_back();
+            pc = instruction.argument;
+            break;
+          }
+
+          case Opcode::FAIL: {
+            success = false;
+            break;
+          }
+
+          case Opcode::FAIL_TWICE: {
+            backtrack.pop_back();
+            success = false;
+            break;
+          }
+
+          case Opcode::INVALID_RULE: {
+            throw Parser::GrammarError(Parser::GrammarError::INVALID_RULE,
+                                       program.invalidNodes[instruction.argument]);
+          }
+
+          case Opcode::END: {
+            return result;
+          }
+        }
+
+        if (!success) {
+          if (diagnosis) {
+            recordFailure(instruction);
+          }
+          if (!fail(pc)) {
+            return result;
+          }
+        }
+      }
+    }
+  };
+
+  Parser::Result parse(const std::string_view &str, const bytecode::Program &program,
+                       TreeArena *arena = nullptr,
+                       std::vector<MemoizationProfile::Entry> *statistics = nullptr) {
+    State state(str, program.rules.size(), arena);
+    state.statistics = statistics;
+    PARSER_TRACE("Begin parsing of: '" << str << "'");
+    Machine machine(program, state);
+    auto result = machine.run();
+    return machine.getResult(result);
+  }
+
+  /** the read-only contents of a file, memory-mapped where supported */
+  class MappedFile {
+  private:
+    std::string_view contents;
+#ifdef PEG_PARSER_MMAP
+    void *address = nullptr;
+#else
+    std::string buffer;
+#endif
+
+  public:
+    explicit MappedFile(const std::string &path) {
+#ifdef PEG_PARSER_MMAP
+      auto descriptor = ::open(path.c_str(), O_RDONLY);
+      if (descriptor < 0) {
+        throw std::runtime_error("cannot open file: " + path);
+      }
+      struct stat status;
+      if (::fstat(descriptor, &status) != 0) {
+        ::close(descriptor);
+        throw std::runtime_error("cannot read file: " + path);
+      }
+      auto size = size_t(status.st_size);
+      if (size > 0) {
+        address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+      }
+      ::close(descriptor);
+      if (address == MAP_FAILED) {
+        address = nullptr;
+        throw std::runtime_error("cannot map file: " + path);
+      }
+      if (address) {
+        // the parser mostly advances linearly, allowing aggressive read-ahead
+        ::madvise(address, size, MADV_SEQUENTIAL);
+        contents = std::string_view(static_cast<const char *>(address), size);
+      }
+#else
+      std::ifstream stream(path, std::ios::binary);
+      if (!stream) {
+        throw std::runtime_error("cannot open file: " + path);
+      }
+      buffer.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+      contents = buffer;
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#ifdef PEG_PARSER_MMAP
+      if (address) {
+        ::munmap(address, contents.size());
+      }
+#endif
+    }
+
+    std::string_view view() const { return contents; }
+  };
+
+  /** owns the file referenced by syntax trees created by `Parser::parseFile` */
+  struct ParsedFile {
+    MappedFile file;
+    Parser::Result result;
+    explicit ParsedFile(const std::string &path) : file(path) {}
+  };
+
+  /** owns the memory of syntax trees created by `Parser::parseInArena` */
+  struct Arena {
+    std::shared_ptr<const bytecode::Program> program;
+    TreeArena trees;
+    Arena(const std::shared_ptr<const bytecode::Program> &p, std::pmr::memory_resource *upstream)
+        : program(p), trees(upstream) {}
+  };
+
+}  // namespace
+
+SyntaxTree::SyntaxTree(const std::shared_ptr<grammar::Rule> &r, std::string_view s, size_t p)
+    : rule(r), fullString(s), begin(p), end(p), valid(false), active(true) {}
+
+SyntaxTree::~SyntaxTree() {
+  // release deeply nested trees iteratively to avoid overflowing the call stack
+  auto pending = std::move(inner);
+  while (!pending.empty()) {
+    auto tree = std::move(pending.back());
+    pending.pop_back();
+    if (tree.use_count() == 1) {
+      std::move(tree->inner.begin(), tree->inner.end(), std::back_inserter(pending));
+      tree->inner.clear();
+    }
+  }
+}
+
+CompactSyntaxTree::CompactSyntaxTree(const SyntaxTree &tree)
+    : fullString(tree.fullString), valid(tree.valid) {
+  bool wide = fullString.size() > std::numeric_limits<std::uint32_t>::max();
+  std::unordered_map<grammar::Rule *, Index> ruleIndices;
+  // breadth-first order keeps the children of each node contiguous
+  std::vector<const SyntaxTree *> nodes{&tree};
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    auto node = nodes[i];
+    auto it = ruleIndices.find(node->rule.get());
+    if (it == ruleIndices.end()) {
+      it = ruleIndices.emplace(node->rule.get(), Index(rules.size())).first;
+      rules.push_back(node->rule);
+    }
+    rule.push_back(it->second);
+    firstChild.push_back(Index(nodes.size()));
+    childCount.push_back(Index(node->inner.size()));
+    if (wide) {
+      widePositions.push_back(node->begin);
+      widePositions.push_back(node->end);
+    } else {
+      narrowPositions.push_back(std::uint32_t(node->begin));
+      narrowPositions.push_back(std::uint32_t(node->end));
+    }
+    for (auto &child : node->inner) {
+      nodes.push_back(child.get());
+    }
+  }
+  rule.shrink_to_fit();
+  firstChild.shrink_to_fit();
+  childCount.shrink_to_fit();
+  narrowPositions.shrink_to_fit();
+  widePositions.shrink_to_fit();
+}
+
+const char *peg_parser::Parser::GrammarError::what() const noexcept {
+  if (buffer.size() == 0) {
+    std::string typeName;
     switch (type) {
       case UNKNOWN_SYMBOL:
         typeName = "UNKNOWN_SYMBOL";
@@ -440,24 +1670,143 @@ const char *peg_parser::Parser::GrammarError::what() const noexcept {
       case INVALID_RULE:
         typeName = "INVALID_RULE";
         break;
+      case INVALID_LABEL:
+        typeName = "INVALID_LABEL";
+        break;
+      case INVALID_CUT:
+        typeName = "INVALID_CUT";
+        break;
+    }
+    if (type == INVALID_LABEL) {
+      buffer = "labeled capture without a fixed child position: " + streamToString(*node);
+    } else if (type == INVALID_CUT) {
+      buffer = "cut without an alternative to commit: " + streamToString(*node);
+    } else {
+      buffer = "internal error in grammar node (" + typeName + "): " + streamToString(*node);
     }
-    buffer = "internal error in grammar node (" + typeName + "): " + streamToString(*node);
   }
   return buffer.c_str();
 }
 
+struct ParseContext::Implementation {
+  std::shared_ptr<const bytecode::Program> program;
+  std::unique_ptr<State> state;
+  std::unique_ptr<Machine> machine;
+
+  Parser::Result parse(const std::string_view &str,
+                       const std::shared_ptr<const bytecode::Program> &current, bool ownsRules,
+                       Parser::Reducer *reducer = nullptr) {
+    if (program != current) {
+      machine.reset();
+      state = std::make_unique<State>(str, current->rules.size());
+      machine = std::make_unique<Machine>(*current, *state);
+      program = current;
+    } else {
+      state->reset(str);
+      machine->reset();
+    }
+    state->ownsRules = ownsRules;
+    machine->reducer = reducer;
+    if (reducer) {
+      reducer->program = current.get();
+    }
+    auto tree = machine->run();
+    auto result = machine->getResult(tree);
+    result.program = current;
+    return result;
+  }
+};
+
+struct peg_parser::IncrementalState {
+  std::shared_ptr<const bytecode::Program> program;
+  std::string input;
+  MemoTable cache;
+  /** keeps the result alive if it is not stored in the memo table */
+  std::shared_ptr<SyntaxTree> syntax;
+  std::shared_ptr<SyntaxTree> error;
+
+  IncrementalState(std::shared_ptr<const bytecode::Program> p, std::string i)
+      : program(std::move(p)), input(std::move(i)), cache(program->rules.size(), true) {}
+};
+
+namespace {
+
+  /** the maximum number of characters an instruction reads beyond the current position */
+  size_t getLookahead(const bytecode::Program &program) {
+    size_t lookahead = 1;
+    for (auto &word : program.words) {
+      lookahead = std::max(lookahead, word.size());
+    }
+    for (auto &table : program.keywordTables) {
+      for (auto &keyword : table.getKeywords()) {
+        lookahead = std::max(lookahead, keyword.size());
+      }
+    }
+    return lookahead;
+  }
+
+  /**
+   * Moves the trees retained in `cache` that follow an edit and points them to `input`. Trees
+   * preceding the edit still refer to the same characters and are only updated if `relocated`
+   * is set, i.e. if the input has been moved to another buffer.
+   */
+  void moveRetainedTrees(const MemoTable &cache, std::string_view input, const Parser::Edit &edit,
+                         bool relocated) {
+    // trees can be shared and are marked as active once they have been visited
+    std::vector<SyntaxTree *> visited, pending;
+    auto add = [&](const std::shared_ptr<SyntaxTree> &tree) {
+      if (!tree->active) {
+        tree->active = true;
+        visited.push_back(tree.get());
+        pending.push_back(tree.get());
+      }
+    };
+    auto end = edit.offset + edit.deleted;
+    cache.forEachTree(add, relocated ? 0 : edit.offset + edit.inserted.size());
+    while (!pending.empty()) {
+      auto tree = pending.back();
+      pending.pop_back();
+      tree->fullString = input;
+      // retained trees lie either completely before or completely after the edit
+      if (tree->begin >= end) {
+        tree->begin = tree->begin - edit.deleted + edit.inserted.size();
+        tree->end = tree->end - edit.deleted + edit.inserted.size();
+      }
+      for (auto &child : tree->inner) {
+        add(child);
+      }
+    }
+    for (auto tree : visited) {
+      tree->active = false;
+    }
+  }
+
+  Parser::Result parseIncremental(const std::shared_ptr<IncrementalState> &incremental) {
+    State state(incremental->input, std::move(incremental->cache));
+    Machine machine(*incremental->program, state);
+    incremental->syntax = machine.run();
+    incremental->error = machine.getResult(incremental->syntax).error;
+    incremental->cache = state.releaseCache();
+    return Parser::Result{std::shared_ptr<SyntaxTree>(incremental, incremental->syntax.get()),
+                          std::shared_ptr<SyntaxTree>(incremental, incremental->error.get()),
+                          incremental, incremental->program};
+  }
+
+}  // namespace
+
 Parser::Parser(const std::shared_ptr<grammar::Rule> &g) : grammar(g) {}
 
 Parser::Result Parser::parseAndGetError(const std::string_view &str,
                                         std::shared_ptr<grammar::Rule> grammar) {
-  State state(str);
-  PARSER_TRACE("Begin parsing of: '" << str << "'");
-  auto result = parseRule(grammar, state);
-  auto error = state.getErrorTree();
-  if (!error) {
-    error = result;
-  }
-  return Parser::Result{result, error};
+  auto program = bytecode::compile(grammar);
+  auto result = parseAndGetError(str, *program);
+  result.program = program;
+  return result;
+}
+
+Parser::Result Parser::parseAndGetError(const std::string_view &str,
+                                        const bytecode::Program &program) {
+  return ::parse(str, program);
 }
 
 std::shared_ptr<SyntaxTree> Parser::parse(const std::string_view &str,
@@ -466,13 +1815,329 @@ std::shared_ptr<SyntaxTree> Parser::parse(const std::string_view &str,
 }
 
 std::shared_ptr<SyntaxTree> Parser::parse(const std::string_view &str) const {
-  return parse(str, grammar);
+  return parseAndGetError(str).syntax;
 }
 
 Parser::Result Parser::parseAndGetError(const std::string_view &str) const {
-  return parseAndGetError(str, grammar);
+  auto current = getProgram();
+  auto result = parseAndGetError(str, *current);
+  result.program = current;
+  return result;
+}
+
+std::shared_ptr<SyntaxTree> Parser::parse(const std::string_view &str,
+                                          ParseContext &context) const {
+  return parseAndGetError(str, context).syntax;
+}
+
+Parser::Result Parser::parseAndGetError(const std::string_view &str,
+                                        ParseContext &context) const {
+  return context.implementation->parse(str, getProgram(), true);
 }
 
+Parser::Result Parser::parseAndReduce(const std::string_view &str, Reducer &reducer) const {
+  auto program = getProgram();
+  State state(str, program->rules.size());
+  Machine machine(*program, state);
+  machine.reducer = &reducer;
+  reducer.program = program.get();
+  auto tree = machine.run();
+  auto result = machine.getResult(tree);
+  result.program = program;
+  return result;
+}
+
+Parser::Result Parser::parseAndReduce(const std::string_view &str, ParseContext &context,
+                                      Reducer &reducer) const {
+  return context.implementation->parse(str, getProgram(), true, &reducer);
+}
+
+Parser::Diagnosis Parser::diagnose(const std::string_view &str) const {
+  auto current = getProgram();
+  Diagnosis diagnosis;
+  State state(str, current->rules.size());
+  Machine machine(*current, state);
+  machine.diagnosis = &diagnosis;
+  machine.run();
+  return diagnosis;
+}
+
+Parser::Result Parser::parseInArena(const std::string_view &str,
+                                    std::pmr::memory_resource *upstream) const {
+  auto arena = std::allocate_shared<Arena>(std::pmr::polymorphic_allocator<Arena>(upstream),
+                                           getProgram(), upstream);
+  auto result = ::parse(str, *arena->program, &arena->trees);
+  return Result{std::shared_ptr<SyntaxTree>(arena, result.syntax.get()),
+                std::shared_ptr<SyntaxTree>(arena, result.error.get()), nullptr, arena->program};
+}
+
+Parser::Result Parser::parseFile(const std::string &path) const {
+  auto parsed = std::make_shared<ParsedFile>(path);
+  auto current = getProgram();
+  parsed->result = ::parse(parsed->file.view(), *current);
+  return Result{std::shared_ptr<SyntaxTree>(parsed, parsed->result.syntax.get()),
+                std::shared_ptr<SyntaxTree>(parsed, parsed->result.error.get()), nullptr, current};
+}
+
+Parser::Result Parser::parseIncremental(const std::string_view &str) const {
+  return ::parseIncremental(std::make_shared<IncrementalState>(getProgram(), std::string(str)));
+}
+
+Parser::Result Parser::reparse(Result &&previous, const Edit &edit) const {
+  if (!previous.incremental) {
+    throw std::invalid_argument("reparse requires the result of an incremental parse");
+  }
+  if (edit.offset > previous.incremental->input.size()
+      || edit.deleted > previous.incremental->input.size() - edit.offset) {
+    throw std::out_of_range("edit exceeds the parsed input");
+  }
+  auto retained = std::move(previous.incremental);
+  previous = Result();
+  auto current = getProgram();
+  auto data = retained->input.data();
+  // the input is edited in place, so that trees preceding the edit remain valid
+  auto incremental = std::make_shared<IncrementalState>(current, std::move(retained->input));
+  incremental->input.replace(edit.offset, edit.deleted, edit.inserted);
+  if (current == retained->program) {
+    incremental->cache = std::move(retained->cache);
+    incremental->cache.applyEdit(edit.offset, edit.deleted, edit.inserted.size(),
+                                 getLookahead(*current));
+    moveRetainedTrees(incremental->cache, incremental->input, edit,
+                      incremental->input.data() != data);
+  }
+  return ::parseIncremental(incremental);
+}
+
+std::vector<Parser::Result> Parser::parseBatch(const std::vector<std::string_view> &inputs,
+                                               ThreadPool &pool) const {
+  std::vector<Result> results(inputs.size());
+  parseBatch(
+      inputs, [&](size_t index, Result &result) { results[index] = std::move(result); }, pool);
+  return results;
+}
+
+void Parser::parseBatch(const std::vector<std::string_view> &inputs,
+                        const BatchCallback &process, ThreadPool &pool) const {
+  auto current = getProgram();
+  std::vector<ParseContext> contexts(pool.size());
+  pool.run(inputs.size(), [&](size_t index, size_t worker) {
+    auto result = contexts[worker].implementation->parse(inputs[index], current, true);
+    process(index, result);
+  });
+}
+
+Parser::Result Parser::parseParallel(const std::string_view &str, ThreadPool &pool) const {
+  auto current = getProgram();
+  auto &rule = synchronization.rule;
+  auto entry = std::find_if(current->rules.begin(), current->rules.end(),
+                            [&](auto &entry) { return entry.rule == rule; });
+  auto chunkSize = std::max<size_t>(1, synchronization.chunkSize);
+  auto chunks = std::min(str.size() / chunkSize, 4 * pool.size());
+  if (!rule || entry == current->rules.end() || !entry->memoize || chunks < 2) {
+    auto result = parseAndGetError(str, *current);
+    result.program = current;
+    return result;
+  }
+  auto index = std::uint32_t(entry - current->rules.begin());
+  auto findCandidate = [&](size_t position) {
+    if (position >= str.size() || !synchronization.findCandidate) {
+      return position;
+    }
+    return std::max(position, synchronization.findCandidate(str, position));
+  };
+
+  // speculatively parse the invocations of the synchronization rule in every chunk
+  std::vector<std::vector<std::shared_ptr<SyntaxTree>>> parsed(chunks);
+  pool.run(chunks, [&](size_t chunk, size_t) {
+    auto end = str.size() * (chunk + 1) / chunks;
+    auto position = findCandidate(str.size() * chunk / chunks);
+    State state(str, current->rules.size(), nullptr, position);
+    Machine machine(*current, state);
+    while (position < end) {
+      state.setPosition(position);
+      auto tree = machine.runRule(index);
+      if (tree->valid && tree->end > position) {
+        position = findCandidate(tree->end);
+        parsed[chunk].push_back(std::move(tree));
+      } else {
+        position = findCandidate(position + 1);
+      }
+    }
+  });
+
+  // invocations at positions the sequential parse never reaches are ignored, so misaligned
+  // chunks are parsed sequentially
+  State state(str, current->rules.size());
+  for (auto &trees : parsed) {
+    for (auto &tree : trees) {
+      state.addToCache(index, tree);
+    }
+  }
+  Machine machine(*current, state);
+  auto tree = machine.run();
+  auto result = machine.getResult(tree);
+  result.program = current;
+  return result;
+}
+
+CompactSyntaxTree Parser::parseCompact(const std::string_view &str) const {
+  auto current = getProgram();
+  TreeArena arena;
+  CompactSyntaxTree tree(*::parse(str, *current, &arena).syntax);
+  // rules of arena trees do not own the rule, replace them by owning references
+  for (auto &rule : tree.rules) {
+    for (auto &entry : current->rules) {
+      if (entry.rule == rule) {
+        rule = entry.rule;
+        break;
+      }
+    }
+  }
+  return tree;
+}
+
+Parser::Result Parser::parseAndProfile(const std::string_view &str,
+                                       MemoizationProfile &profile) const {
+  auto current = bytecode::compile(grammar, MemoizationPolicy::full());
+  std::vector<MemoizationProfile::Entry> statistics(current->rules.size());
+  auto result = ::parse(str, *current, nullptr, &statistics);
+  for (auto &&[i, entry] : easy_iterator::enumerate(current->rules)) {
+    auto &stored = profile.rules[entry.rule->name];
+    stored.invocations += statistics[i].invocations;
+    stored.hits += statistics[i].hits;
+  }
+  result.program = current;
+  return result;
+}
+
+std::shared_ptr<const bytecode::Program> Parser::getProgram() const {
+  auto current = std::atomic_load(&program);
+  if (!current || !current->isCompiledFrom(grammar, memoization)) {
+    current = bytecode::compile(grammar, memoization);
+    std::atomic_store(&program, current);
+  }
+  return current;
+}
+
+FrozenParser Parser::freeze() const { return FrozenParser(*this); }
+
+FrozenParser::FrozenParser(const Parser &parser) : program(parser.getProgram()) {}
+
+std::shared_ptr<SyntaxTree> FrozenParser::parse(const std::string_view &str) const {
+  return parseAndGetError(str).syntax;
+}
+
+Parser::Result FrozenParser::parseAndGetError(const std::string_view &str) const {
+  State state(str, program->rules.size());
+  state.ownsRules = false;
+  Machine machine(*program, state);
+  auto tree = machine.run();
+  auto result = machine.getResult(tree);
+  result.program = program;
+  return result;
+}
+
+std::shared_ptr<SyntaxTree> FrozenParser::parse(const std::string_view &str,
+                                                ParseContext &context) const {
+  return parseAndGetError(str, context).syntax;
+}
+
+Parser::Result FrozenParser::parseAndGetError(const std::string_view &str,
+                                              ParseContext &context) const {
+  return context.implementation->parse(str, program, false);
+}
+
+ParseContext::ParseContext() : implementation(std::make_unique<Implementation>()) {}
+ParseContext::ParseContext(ParseContext &&) = default;
+ParseContext &ParseContext::operator=(ParseContext &&) = default;
+ParseContext::~ParseContext() = default;
+
+struct PushParser::Implementation {
+  std::shared_ptr<const bytecode::Program> program;
+  ItemCallback onItem;
+  std::string buffer;
+  size_t offset = 0;
+  State state;
+  Machine machine;
+  std::shared_ptr<SyntaxTree> result;
+
+  Implementation(std::shared_ptr<const bytecode::Program> p, ItemCallback c)
+      : program(std::move(p)),
+        onItem(std::move(c)),
+        state(std::string_view(), program->rules.size()),
+        machine(*program, state) {
+    state.complete = false;
+    machine.relocatable = true;
+    if (onItem) {
+      machine.onItem = &onItem;
+    }
+  }
+
+  void run() {
+    state.string = buffer;
+    result = machine.run();
+    if (!result) {
+      machine.emitCommittedItems();
+      releaseInput();
+    }
+  }
+
+  /** drops the consumed input once it makes up at least half of the buffer */
+  void releaseInput() {
+    auto position = machine.getRetainedPosition();
+    if (position == 0 || 2 * position < buffer.size()) {
+      return;
+    }
+    machine.rebase(position);
+    buffer.erase(0, position);
+    offset += position;
+    state.string = buffer;
+  }
+};
+
+PushParser::PushParser(const Parser &parser, ItemCallback onItem)
+    : implementation(std::make_unique<Implementation>(parser.getProgram(), std::move(onItem))) {}
+
+PushParser::~PushParser() = default;
+
+PushParser::Status PushParser::feed(std::string_view chunk) {
+  auto &impl = *implementation;
+  if (!impl.result) {
+    impl.buffer.append(chunk);
+    impl.run();
+  }
+  return impl.result ? Status::COMPLETE : Status::NEEDS_INPUT;
+}
+
+Parser::Result PushParser::finish() {
+  auto &impl = *implementation;
+  if (!impl.result) {
+    impl.state.complete = true;
+    impl.run();
+  }
+  // the result owns the remaining input
+  struct Owner {
+    std::string input;
+    std::shared_ptr<SyntaxTree> tree;
+    std::shared_ptr<SyntaxTree> error;
+  };
+  auto owner = std::make_shared<Owner>(Owner{std::move(impl.buffer), impl.result, nullptr});
+  impl.state.string = owner->input;
+  impl.machine.refreshStrings(owner->tree);
+  owner->error = impl.machine.getResult(owner->tree).error;
+  if (impl.onItem && owner->tree->valid) {
+    for (auto &item : owner->tree->inner) {
+      impl.onItem(item);
+    }
+    owner->tree->inner.clear();
+  }
+  return Parser::Result{std::shared_ptr<SyntaxTree>(owner, owner->tree.get()),
+                        std::shared_ptr<SyntaxTree>(owner, owner->error.get()), nullptr,
+                        impl.program};
+}
+
+size_t PushParser::getOffset() const { return implementation->offset; }
+
 std::ostream &peg_parser::operator<<(std::ostream &stream, const SyntaxTree &tree) {
   stream << tree.rule->name << '(';
   if (tree.inner.size() == 0) {
@@ -485,3 +2150,29 @@ std::ostream &peg_parser::operator<<(std::ostream &stream, const SyntaxTree &tre
   stream << ')';
   return stream;
 }
+
+namespace {
+
+  void printCompactSyntaxTree(std::ostream &stream, const CompactSyntaxTree &tree,
+                              CompactSyntaxTree::Index node) {
+    stream << tree.getRule(node)->name << '(';
+    auto count = tree.childCount[node];
+    if (count == 0) {
+      stream << '\'' << tree.view(node) << '\'';
+    } else {
+      for (CompactSyntaxTree::Index i = 0; i < count; ++i) {
+        printCompactSyntaxTree(stream, tree, tree.child(node, i));
+        stream << (i + 1 == count ? "" : ", ");
+      }
+    }
+    stream << ')';
+  }
+
+}  // namespace
+
+std::ostream &peg_parser::operator<<(std::ostream &stream, const CompactSyntaxTree &tree) {
+  if (tree.size() > 0) {
+    printCompactSyntaxTree(stream, tree, 0);
+  }
+  return stream;
+}
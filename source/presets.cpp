@@ -139,6 +139,9 @@ GrammarProgram presets::createPEGProgram() {
   auto any = GN::Rule(
       program.interpreter.makeRule("Any", GN::Word("."), [](auto, auto &) { return GN::Any(); }));
 
+  auto cut = GN::Rule(
+      program.interpreter.makeRule("Cut", GN::Word("^"), [](auto, auto &) { return GN::Cut(); }));
+
   auto selectCharacterProgram = createCharacterProgram();
   auto selectCharacter = GN::Sequence({GN::Not(GN::Choice({GN::Word("-"), GN::Word("]")})),
                                        GN::Rule(selectCharacterProgram.parser.grammar)});
@@ -197,7 +200,7 @@ GrammarProgram presets::createPEGProgram() {
                                    [](auto e, auto &g) { return GN::Not(e[0].evaluate(g)); }));
 
   atomicRule->node = withWhitespace(
-      GN::Choice({andPredicate, notPredicate, word, brackets, endOfFile, any, select, rule}));
+      GN::Choice({andPredicate, notPredicate, word, brackets, endOfFile, any, cut, select, rule}));
 
   auto predicate
       = GN::Rule(makeRule("Predicate", GN::Choice({GN::Word("+"), GN::Word("*"), GN::Word("?")})));
@@ -221,8 +224,15 @@ GrammarProgram presets::createPEGProgram() {
         throw std::runtime_error("unexpected unary operator");
       })));
 
+  auto label = GN::Rule(makeRule("Label", ruleName));
+  auto labeled = GN::Rule(program.interpreter.makeRule(
+      "Labeled", GN::Sequence({whitespace, label, GN::Word(":"), unary}), [](auto e, auto &g) {
+        return GN::Capture(e[0].string(), e[1].evaluate(g));
+      }));
+  auto element = GN::Choice({labeled, unary});
+
   auto sequence = GN::Rule(program.interpreter.makeRule(
-      "Sequence", GN::Sequence({unary, GN::ZeroOrMore(unary)}), [](auto e, auto &g) {
+      "Sequence", GN::Sequence({element, GN::ZeroOrMore(element)}), [](auto e, auto &g) {
         if (e.size() == 1) {
           return e[0].evaluate(g);
         }
@@ -0,0 +1,198 @@
+#include <peg_parser/thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace peg_parser;
+
+namespace {
+
+  /** the indices a worker has yet to process, aligned to avoid false sharing */
+  struct alignas(64) Range {
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  /** set while the current thread executes a task of any pool */
+  thread_local bool insideTask = false;
+
+  struct TaskScope {
+    TaskScope() { insideTask = true; }
+    ~TaskScope() { insideTask = false; }
+  };
+
+}  // namespace
+
+struct ThreadPool::Implementation {
+  std::vector<std::thread> threads;
+  std::vector<Range> ranges;
+
+  /** serializes calls to `run` */
+  std::mutex batch;
+
+  std::mutex mutex;
+  std::condition_variable wake, done;
+  const Task *task = nullptr;
+  size_t generation = 0;
+  size_t busy = 0;
+  bool stopping = false;
+  std::exception_ptr error;
+  /** set once a task of the current batch has thrown, the remaining indices are skipped */
+  std::atomic<bool> aborted{false};
+
+  explicit Implementation(size_t workers) : ranges(workers) {
+    for (size_t worker = 1; worker < workers; ++worker) {
+      threads.emplace_back([this, worker]() { wait(worker); });
+    }
+  }
+
+  ~Implementation() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  void wait(size_t worker) {
+    size_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake.wait(lock, [&]() { return stopping || generation != seen; });
+      if (stopping) {
+        return;
+      }
+      seen = generation;
+      lock.unlock();
+      work(worker);
+      lock.lock();
+      if (--busy == 0) {
+        done.notify_all();
+      }
+    }
+  }
+
+  /** takes the next index of `worker`'s range or steals from another worker */
+  bool next(size_t worker, size_t &index) {
+    if (aborted.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    {
+      auto &own = ranges[worker];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (own.begin < own.end) {
+        index = own.begin++;
+        return true;
+      }
+    }
+    for (size_t offset = 1; offset < ranges.size(); ++offset) {
+      auto &victim = ranges[(worker + offset) % ranges.size()];
+      size_t begin, end;
+      {
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.begin == victim.end) {
+          continue;
+        }
+        end = victim.end;
+        begin = end - (end - victim.begin + 1) / 2;
+        victim.end = begin;
+      }
+      auto &own = ranges[worker];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      // the ranges may have been cleared since the steal, which must not install it again
+      if (aborted.load()) {
+        return false;
+      }
+      own.begin = begin + 1;
+      own.end = end;
+      index = begin;
+      return true;
+    }
+    return false;
+  }
+
+  void work(size_t worker) {
+    TaskScope scope;
+    size_t index;
+    while (next(worker, index)) {
+      try {
+        (*task)(index, worker);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        // skip the remaining indices, `aborted` is set first so that no thief can restore a
+        // range it took before
+        aborted = true;
+        for (auto &range : ranges) {
+          std::lock_guard<std::mutex> rangeLock(range.mutex);
+          range.begin = range.end;
+        }
+      }
+    }
+  }
+};
+
+ThreadPool::ThreadPool(size_t threads) {
+  if (threads == 0) {
+    threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+  }
+  implementation = std::make_unique<Implementation>(threads);
+}
+
+ThreadPool::~ThreadPool() = default;
+
+size_t ThreadPool::size() const { return implementation->ranges.size(); }
+
+void ThreadPool::run(size_t count, const Task &task) {
+  auto &impl = *implementation;
+  if (insideTask || impl.threads.empty() || count <= 1) {
+    // avoids waiting for workers that may themselves be waiting for the calling task
+    for (size_t index = 0; index < count; ++index) {
+      task(index, 0);
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> batch(impl.batch);
+  auto workers = impl.ranges.size();
+  for (size_t worker = 0; worker < workers; ++worker) {
+    auto &range = impl.ranges[worker];
+    std::lock_guard<std::mutex> lock(range.mutex);
+    range.begin = count * worker / workers;
+    range.end = count * (worker + 1) / workers;
+  }
+  {
+    std::lock_guard<std::mutex> lock(impl.mutex);
+    impl.task = &task;
+    impl.error = nullptr;
+    impl.aborted = false;
+    impl.busy = impl.threads.size();
+    ++impl.generation;
+  }
+  impl.wake.notify_all();
+  impl.work(0);
+
+  std::unique_lock<std::mutex> lock(impl.mutex);
+  impl.done.wait(lock, [&]() { return impl.busy == 0; });
+  impl.task = nullptr;
+  if (impl.error) {
+    std::rethrow_exception(std::exchange(impl.error, nullptr));
+  }
+}
+
+ThreadPool &ThreadPool::shared() {
+  static ThreadPool pool;
+  return pool;
+}
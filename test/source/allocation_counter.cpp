@@ -0,0 +1,23 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/** the number of bytes requested from the global `operator new` */
+std::atomic<size_t> allocatedBytes{0};
+
+// kept apart from the code that allocates, which would otherwise inline these definitions
+void *operator new(size_t size) {
+  allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  if (auto pointer = std::malloc(size > 0 ? size : 1)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  return std::malloc(size > 0 ? size : 1);
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
@@ -1,9 +1,17 @@
 #include <peg_parser/generator.h>
+#include <peg_parser/static_grammar.h>
 
+#include <algorithm>
+#include <atomic>
 #include <catch2/catch.hpp>
+#include <cstdio>
+#include <fstream>
+#include <memory_resource>
 #include <numeric>
+#include <random>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <tuple>
 
 template <class T> std::string stream_to_string(const T &obj) {
@@ -12,6 +20,9 @@ template <class T> std::string stream_to_string(const T &obj) {
   return stream.str();
 }
 
+/** the number of bytes requested from the global `operator new`, see allocation_counter.cpp */
+extern std::atomic<size_t> allocatedBytes;
+
 using namespace peg_parser;
 
 TEST_CASE("Number Program") {
@@ -295,3 +306,1301 @@ TEST_CASE("Subscript Operators") {
   REQUIRE(!program.run("hello"));
   REQUIRE(program.run("HELLO"));
 }
+
+TEST_CASE("Deep nesting") {
+  ParserGenerator<> program;
+  program.setStart(program["Nested"] << "'(' Nested ')' | 'x'");
+  size_t depth = 100000;
+  auto input = std::string(depth, '(') + "x" + std::string(depth, ')');
+  auto tree = program.parse(input);
+  REQUIRE(tree->valid);
+  REQUIRE(tree->end == input.size());
+  REQUIRE(!program.parse(input.substr(0, input.size() - 1))->valid);
+}
+
+TEST_CASE("Grammar modifications") {
+  ParserGenerator<> program;
+  program.setStart(program["B"] << "A+");
+  program["A"] << "'a'";
+  REQUIRE(program.parse("aa")->valid);
+  REQUIRE(!program.parse("bb")->valid);
+  auto compiled = program.parser.getProgram();
+  REQUIRE(compiled == program.parser.getProgram());
+  program["A"] << "'b'";
+  REQUIRE(!program.parse("aa")->valid);
+  REQUIRE(program.parse("bb")->valid);
+  REQUIRE(stream_to_string(*program.parse("bb")) == "B(A('b'), A('b'))");
+  program["A"]->hidden = true;
+  REQUIRE(stream_to_string(*program.parse("bb")) == "B('bb')");
+  REQUIRE(compiled != program.parser.getProgram());
+
+  SECTION("rules reassigned twice between parses") {
+    for (int i = 0; i < 100; ++i) {
+      program["A"] << "'c'";
+      program["A"] << "'d'";
+      REQUIRE(program.parse("dd")->valid);
+      program["A"] << "'e'";
+      program["A"] << "'b'";
+      REQUIRE(program.parse("bb")->valid);
+    }
+  }
+
+  SECTION("nested nodes replaced") {
+    auto node = program["B"]->node;
+    std::get<grammar::Node::Shared>(node->data) = grammar::Node::Word("c");
+    REQUIRE(program.parse("cc")->valid);
+  }
+}
+
+TEST_CASE("Choice dispatch") {
+  ParserGenerator<> program;
+  program["Keyword"] << "'if' | 'in'";
+  program["Identifier"] << "[a-z]+";
+  program.setStart(program["Value"] << "Keyword !. | Identifier | [0-9]+ | ''");
+  REQUIRE(stream_to_string(*program.parse("in")) == "Value(Keyword('in'))");
+  REQUIRE(stream_to_string(*program.parse("inner")) == "Value(Identifier('inner'))");
+  REQUIRE(stream_to_string(*program.parse("42")) == "Value('42')");
+  REQUIRE(program.parse("")->valid);
+  REQUIRE(program.parse("-")->end == 0);
+
+  auto compiled = program.parser.getProgram();
+  REQUIRE(compiled->rules[0].lookahead.nullable);
+  auto &keyword = compiled->rules[1].lookahead;
+  REQUIRE(!keyword.nullable);
+  REQUIRE(keyword.first.count() == 1);
+  REQUIRE(keyword.first['i']);
+  REQUIRE(stream_to_string(*compiled).find("select") != std::string::npos);
+
+  using namespace grammar;
+  auto twoBytes = Node::Sequence({Node::Range('\xC0', '\xDF'), Node::Any()});
+  auto utf8 = makeRule("UTF8", Node::Choice({twoBytes, Node::Word("a")}));
+  REQUIRE(Parser::parse("\xC3\xA9", utf8)->end == 2);
+  REQUIRE(Parser::parse("a", utf8)->valid);
+  REQUIRE(!Parser::parse("b", utf8)->valid);
+}
+
+TEST_CASE("Character class spans") {
+  ParserGenerator<> program;
+  program["Identifier"] << "[a-zA-Z_] [a-zA-Z0-9_]*";
+  program["Digits"] << "[0-9]+";
+  program.setStart(program["Tokens"] << "((Identifier | Digits) ' '*)* <EOF>");
+  REQUIRE(stream_to_string(*program.parser.getProgram()).find("span") != std::string::npos);
+  for (size_t length = 1; length < 80; ++length) {
+    std::string identifier = "a" + std::string(length, 'z') + "9";
+    std::string input = identifier + std::string(length, ' ') + std::string(length, '1');
+    auto tree = program.parse(input);
+    REQUIRE(tree->valid);
+    REQUIRE(tree->inner.size() == 2);
+    REQUIRE(tree->inner[0]->end == identifier.size());
+    REQUIRE(tree->inner[1]->length() == length);
+  }
+  REQUIRE(!program.parse("abc-")->valid);
+
+  using namespace grammar;
+  auto high = makeRule("High", Node::OneOrMore(Node::Range('\x80', '\xFF')));
+  REQUIRE(Parser::parse(std::string(40, '\xE9') + "a", high)->end == 40);
+  REQUIRE(!Parser::parse("a", high)->valid);
+}
+
+TEST_CASE("Scanning until delimiters") {
+  ParserGenerator<> program;
+  program["Comment"] << "'/*' (!'*/' .)* '*/'";
+  program["Line"] << "(!'\n' .)+ '\n'";
+  program.setStart(program["Text"] << "(Comment | Line)* (!'*/' .)*");
+  auto compiled = stream_to_string(*program.parser.getProgram());
+  REQUIRE(compiled.find("scan '*/'") != std::string::npos);
+  REQUIRE(compiled.find("span") != std::string::npos);
+
+  auto tree = program.parse("/* a * b / c **/line one\n/**/x\n");
+  REQUIRE(tree->valid);
+  REQUIRE(stream_to_string(*tree)
+          == "Text(Comment('/* a * b / c **/'), Line('line one\n'), Comment('/**/'), Line('x\n'))");
+  REQUIRE(program.parse("/* unterminated *")->end == 17);
+  REQUIRE(program.parse("rest */")->end == 5);
+  REQUIRE(program.parse("*/")->end == 0);
+}
+
+TEST_CASE("Keyword choices") {
+  ParserGenerator<> program;
+  program["Short"] << "'in' | 'int' | 'i'";
+  program["Long"] << "'int' | 'in' | 'i'";
+  program["Identifier"] << "[a-z]+";
+  program["Token"] << "'<=' | '<' | Identifier | '=' | '=='";
+  program.setStart(program["Tokens"] << "Token*");
+  REQUIRE(stream_to_string(*program.parser.getProgram()).find("keywords '<=' '<'")
+          != std::string::npos);
+  REQUIRE(stream_to_string(*program.parse("<=<a==")) == "Tokens(Token('<='), Token('<'), "
+                                                         "Token(Identifier('a')), Token('='), "
+                                                         "Token('='))");
+
+  program.setStart(program.getRule("Short"));
+  REQUIRE(program.parse("int")->end == 2);
+  REQUIRE(program.parse("ix")->end == 1);
+  REQUIRE(!program.parse("x")->valid);
+  REQUIRE(!program.parse("")->valid);
+  program.setStart(program.getRule("Long"));
+  REQUIRE(program.parse("int")->end == 3);
+  REQUIRE(program.parse("inx")->end == 2);
+
+  std::vector<std::string> keywords;
+  std::string grammar;
+  for (int i = 0; i < 200; ++i) {
+    keywords.push_back(std::string(1, char('a' + i % 26)) + "kw" + std::to_string(i));
+    grammar += (i ? " | '" : "'") + keywords.back() + "'";
+  }
+  program.setStart(program["Keyword"] << grammar);
+  for (auto &keyword : keywords) {
+    // earlier alternatives take precedence, even if they only match a prefix
+    auto expected = *std::find_if(keywords.begin(), keywords.end(),
+                                  [&](auto &k) { return keyword.compare(0, k.size(), k) == 0; });
+    REQUIRE(program.parse(keyword)->end == expected.size());
+  }
+}
+
+TEST_CASE("Memoization") {
+  ParserGenerator<> program;
+  size_t evaluations = 0;
+  program["Item"] << "[a-z]+" << [&](auto &) {
+    evaluations++;
+    return true;
+  };
+  program.setStart(program["List"] << "(Item ';' | Item ',')* <EOF>");
+  std::string input;
+  size_t items = 1000;
+  for (size_t i = 0; i < items; ++i) {
+    input += std::string(1 + i % 7, 'a' + i % 26) + (i % 3 == 0 ? ";" : ",");
+  }
+  auto tree = program.parse(input);
+  REQUIRE(tree->valid);
+  REQUIRE(tree->inner.size() == items);
+  REQUIRE(evaluations == items);
+  program.getRule("Item")->cacheable = false;
+  evaluations = 0;
+  REQUIRE(program.parse(input)->valid);
+  REQUIRE(evaluations == items + items * 2 / 3);
+}
+
+TEST_CASE("Failed attempts") {
+  ParserGenerator<> program;
+  program["Letter"] << "[a-z]";
+  std::vector<size_t> children;
+  program["Word"] << "(Letter Letter '!' | Letter+)" << [&](auto &s) {
+    children.push_back(s->inner.size());
+    return true;
+  };
+  program.setStart(program["Start"] << "Word ' ' Word");
+  auto tree = program.parse("abc de!");
+  REQUIRE(tree->valid);
+  REQUIRE(children == std::vector<size_t>{3, 2});
+  REQUIRE(tree->inner[0]->inner.size() == 3);
+  REQUIRE(tree->inner[1]->inner.size() == 2);
+  REQUIRE(tree->inner[1]->end == 7);
+
+  auto result = program.parser.parseAndGetError("abc 1");
+  REQUIRE(!result.syntax->valid);
+  REQUIRE(result.syntax->rule == program.getRule("Start"));
+  REQUIRE(result.syntax->inner.empty());
+  REQUIRE(result.error->rule == program.getRule("Start"));
+  REQUIRE(!result.error->valid);
+  REQUIRE(result.error->begin == 0);
+  REQUIRE(result.error->end == 4);
+  ParseContext context;
+  REQUIRE(program.parser.parseAndGetError("abc 1", context).error->end == 4);
+  REQUIRE(program.parser.parseInArena("abc 1").error->end == 4);
+  REQUIRE(program.parser.parseIncremental("abc 1").error->end == 4);
+
+  result = program.parser.parseAndGetError("abc de");
+  REQUIRE(result.syntax->valid);
+  REQUIRE(result.error == result.syntax);
+}
+
+TEST_CASE("Memoization policies") {
+  ParserGenerator<> program;
+  size_t evaluations = 0;
+  program["Item"] << "[a-z]+" << [&](auto &) {
+    evaluations++;
+    return true;
+  };
+  program.setStart(program["List"] << "(Item ';' | Item ',')* <EOF>");
+  std::string input;
+  size_t items = 300;
+  for (size_t i = 0; i < items; ++i) {
+    input += std::string(1 + i % 7, 'a' + i % 26) + (i % 3 == 0 ? ";" : ",");
+  }
+  auto countEvaluations = [&](const MemoizationPolicy &policy) {
+    program.parser.memoization = policy;
+    evaluations = 0;
+    REQUIRE(program.parse(input)->valid);
+    return evaluations;
+  };
+  auto isMemoized = [&](const std::string &name) {
+    for (auto &entry : program.parser.getProgram()->rules) {
+      if (entry.rule->name == name) {
+        return entry.memoize;
+      }
+    }
+    throw std::runtime_error("unknown rule");
+  };
+
+  REQUIRE(countEvaluations(MemoizationPolicy::full()) == items);
+  REQUIRE(countEvaluations(MemoizationPolicy::none()) == items + items * 2 / 3);
+  REQUIRE(!isMemoized("Item"));
+  REQUIRE(countEvaluations(MemoizationPolicy::staticAnalysis()) == items);
+  REQUIRE(isMemoized("Item"));
+  REQUIRE(!isMemoized("List"));
+
+  MemoizationProfile profile;
+  program.parser.parseAndProfile(input, profile);
+  REQUIRE(profile.rules["List"].invocations == 1);
+  REQUIRE(profile.rules["Item"].hits == items * 2 / 3);
+  std::stringstream stream;
+  profile.save(stream);
+  auto loaded = std::make_shared<MemoizationProfile>();
+  loaded->load(stream);
+  REQUIRE(loaded->rules["Item"].invocations == profile.rules["Item"].invocations);
+  REQUIRE(countEvaluations(MemoizationPolicy::adaptive(loaded)) == items);
+  REQUIRE(isMemoized("Item"));
+  REQUIRE(!isMemoized("List"));
+
+  std::stringstream invalid("1 x Item");
+  REQUIRE_THROWS(MemoizationProfile().load(invalid));
+
+  ParserGenerator<int> calculator;
+  calculator["Sum"] << "Add | Number";
+  calculator["Add"] << "Sum '+' Number" >> [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+  calculator["Number"] << "[0-9]+" >> [](auto e) { return std::stoi(e.string()); };
+  calculator.setStart(calculator["Sum"]);
+  calculator.parser.memoization = MemoizationPolicy::none();
+  REQUIRE(calculator.run("1+2+3") == 6);
+}
+
+TEST_CASE("Cut") {
+  ParserGenerator<> program;
+  program["Name"] << "[a-z]+";
+  program.setStart(program["Statement"] << "'if' ^ ' ' Name | Name");
+  REQUIRE(stream_to_string(*program.parse("if x")) == "Statement(Name('x'))");
+  REQUIRE(stream_to_string(*program.parse("abc")) == "Statement(Name('abc'))");
+  REQUIRE(!program.parse("ifx")->valid);
+  REQUIRE(stream_to_string(*program.getRule("Statement")->node) == "(('if' ^ ' ' Name) | Name)");
+
+  // cuts commit the innermost choice, repetition or optional
+  program.setStart(program["Repeated"] << "('a' ^)* 'b' | 'a' 'c'");
+  REQUIRE(program.parse("aab")->valid);
+  REQUIRE(program.parse("b")->valid);
+  REQUIRE(program.parse("ac")->valid);
+  program.setStart(program["Iteration"] << "('a' ^ 'b')* 'c'");
+  REQUIRE(program.parse("ababc")->valid);
+  REQUIRE(program.parse("c")->valid);
+  REQUIRE(!program.parse("abac")->valid);
+  program.setStart(program["OneOrMore"] << "('a' ^ 'b')+ 'c' | 'a' 'c'");
+  REQUIRE(program.parse("abc")->valid);
+  REQUIRE(program.parse("ac")->valid);
+  REQUIRE(!program.parse("abac")->valid);
+  program.setStart(program["Optional"] << "('a' ^ 'b')? 'a' 'c'");
+  REQUIRE(program.parse("abac")->valid);
+  REQUIRE(!program.parse("ac")->valid);
+  program.setStart(program["Nested"] << "('a' ^ 'b' | 'a')* 'c'");
+  REQUIRE(program.parse("abc")->valid);
+  REQUIRE(!program.parse("ac")->valid);
+
+  // cuts without anything to commit are rejected
+  for (auto invalid : {"'x' | 'a' ^ 'b'", "'a' ^ 'b'", "&('a' ^) 'a'", "!('a' ^) 'b'"}) {
+    program.setStart(program["Invalid"] << invalid);
+    REQUIRE_THROWS_AS(program.parse("ab"), Parser::GrammarError);
+  }
+  program.setStart(program["Statement"]);
+  REQUIRE(program.parse("if x")->valid);
+
+  ParserGenerator<int> records;
+  records["Sum"] << "Add | Number";
+  records["Add"] << "Sum '+' Number" >> [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+  records["Number"] << "[0-9]+" >> [](auto e) { return std::stoi(e.string()); };
+  records["Record"] << "Sum ';'" >> [](auto e) { return e[0].evaluate(); };
+  records.setStart(records["Records"] << "(Record ^)* <EOF>" >> [](auto e) {
+    int sum = 0;
+    for (auto r : e) {
+      sum += r.evaluate();
+    }
+    return sum;
+  });
+  std::string input;
+  int expected = 0;
+  for (int i = 0; i < 1000; ++i) {
+    input += std::to_string(i) + "+" + std::to_string(i % 7) + "+1;";
+    expected += i + i % 7 + 1;
+  }
+  REQUIRE(records.run(input) == expected);
+  REQUIRE_THROWS_AS(records.run(input + "1+;"), SyntaxError);
+}
+
+TEST_CASE("Push parser") {
+  ParserGenerator<int> records;
+  records["Number"] << "[0-9]+" >> [](auto e) { return std::stoi(e.string()); };
+  records["Record"] << "Number ';'" >> [](auto e) { return e[0].evaluate(); };
+  records.setStart(records["Records"] << "(Record ^)* <EOF>");
+  std::string input;
+  std::vector<int> expected;
+  for (int i = 0; i < 2000; ++i) {
+    input += std::to_string(i * 37) + ";";
+    expected.push_back(i * 37);
+  }
+
+  for (size_t chunkSize : {1, 7, 64, 5000}) {
+    std::vector<int> items;
+    PushParser parser(records.parser, [&](const auto &item) {
+      items.push_back(records.interpreter.evaluate(item));
+      REQUIRE(item->string() == std::to_string(items.back()) + ";");
+    });
+    for (size_t i = 0; i < input.size(); i += chunkSize) {
+      auto chunk = std::string_view(input).substr(i, chunkSize);
+      REQUIRE(parser.feed(chunk) == PushParser::Status::NEEDS_INPUT);
+    }
+    REQUIRE(items.size() + 2 >= expected.size());
+    auto result = parser.finish();
+    REQUIRE(result.syntax->valid);
+    REQUIRE(result.syntax->inner.empty());
+    REQUIRE(items == expected);
+    // consumed input has been released
+    REQUIRE(parser.getOffset() > input.size() / 2);
+  }
+
+  std::vector<int> items;
+  PushParser invalid(records.parser, [&](const auto &item) {
+    items.push_back(records.interpreter.evaluate(item));
+  });
+  REQUIRE(invalid.feed("1;2") == PushParser::Status::NEEDS_INPUT);
+  REQUIRE(items == std::vector<int>{1});
+  REQUIRE(invalid.feed(";x") == PushParser::Status::COMPLETE);
+  REQUIRE(!invalid.finish().syntax->valid);
+
+  ParserGenerator<> tokens;
+  tokens["Word"] << "[a-z]+";
+  tokens["Keyword"] << "('if' | 'else' | 'while') ![a-z]";
+  tokens["Comment"] << "'/*' (!'*/' .)* '*/'";
+  tokens["Number"] << "'0x' [0-9a-f]+ | [0-9]+";
+  tokens.setStart(tokens["Tokens"] << "((Keyword | Word | Comment | Number) ' '?)* <EOF>");
+  std::string text = "if iffy 0x1f /* a * / b */ while whiles 42 else x /***/ 0";
+  auto whole = stream_to_string(*tokens.parse(text));
+  for (size_t chunkSize = 1; chunkSize < 6; ++chunkSize) {
+    PushParser parser(tokens.parser);
+    for (size_t i = 0; i < text.size(); i += chunkSize) {
+      parser.feed(std::string_view(text).substr(i, chunkSize));
+    }
+    auto result = parser.finish();
+    REQUIRE(result.syntax->valid);
+    REQUIRE(stream_to_string(*result.syntax) == whole);
+  }
+
+  ParserGenerator<> prefix;
+  prefix.setStart(prefix["Prefix"] << "'ab'");
+  PushParser parser(prefix.parser);
+  REQUIRE(parser.feed("a") == PushParser::Status::NEEDS_INPUT);
+  REQUIRE(parser.feed("bc") == PushParser::Status::COMPLETE);
+  REQUIRE(parser.finish().syntax->string() == "ab");
+}
+
+TEST_CASE("Long left-recursive chains") {
+  ParserGenerator<int> g;
+  g["Sum"] << "Add | Number";
+  g["Add"] << "Sum '+' Number" >> [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+  g["Number"] << "[0-9]+" >> [](auto e) { return std::stoi(e.string()); };
+  g.setStart(g["Sum"]);
+
+  std::string input = "0";
+  int expected = 0;
+  for (int i = 1; i < 1000; ++i) {
+    input += "+" + std::to_string(i);
+    expected += i;
+  }
+  REQUIRE(g.run(input) == expected);
+
+  for (int i = 0; i < 100000; ++i) {
+    input += "+1";
+  }
+  auto tree = g.parse(input);
+  REQUIRE(tree->valid);
+  REQUIRE(tree->end == input.size());
+}
+
+TEST_CASE("Arena allocation") {
+  struct CountingResource : std::pmr::memory_resource {
+    size_t allocated = 0, deallocated = 0;
+    void *do_allocate(size_t bytes, size_t alignment) override {
+      allocated += bytes;
+      return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+      deallocated += bytes;
+      std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+      return this == &other;
+    }
+  } resource;
+
+  ParserGenerator<int> program;
+  program.setStart(program["Sum"] << "Number ('+' Number)*" >> [](auto e) {
+    int sum = 0;
+    for (auto n : e) {
+      sum += n.evaluate();
+    }
+    return sum;
+  });
+  program["Number"] << "[0-9]+" >> [](auto e) { return std::stoi(e.string()); };
+
+  auto result = program.parser.parseInArena("1+2+3+40", &resource);
+  REQUIRE(resource.allocated > 0);
+  REQUIRE(result.syntax->valid);
+  REQUIRE(stream_to_string(*result.syntax) == stream_to_string(*program.parse("1+2+3+40")));
+  REQUIRE(program.interpret(result.syntax).evaluate() == 46);
+  const std::vector<std::shared_ptr<SyntaxTree>> &children = result.syntax->inner;
+  REQUIRE(children.size() == 4);
+  REQUIRE(!program.parser.parseInArena("x", &resource).syntax->valid);
+
+  result = Parser::Result();
+  REQUIRE(resource.deallocated == resource.allocated);
+}
+
+TEST_CASE("Compact syntax tree") {
+  ParserGenerator<float> g;
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Sum"] << "Add | Subtract | Product";
+  g["Product"] << "Multiply | Divide | Atomic";
+  g["Atomic"] << "Number | '(' Sum ')'";
+  g["Add"] << "Sum '+' Product" >> [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+  g["Subtract"] << "Sum '-' Product" >> [](auto e) { return e[0].evaluate() - e[1].evaluate(); };
+  g["Multiply"] << "Product '*' Atomic" >> [](auto e) { return e[0].evaluate() * e[1].evaluate(); };
+  g["Divide"] << "Product '/' Atomic" >> [](auto e) { return e[0].evaluate() / e[1].evaluate(); };
+  g.setProgramRule("Number", presets::createFloatProgram());
+  g.setStart(g["Sum"]);
+
+  auto input = "1 + 2 * (3+4)/ 2 - 3";
+  auto tree = g.parse(input);
+  auto compact = g.parser.parseCompact(input);
+  REQUIRE(compact.valid);
+  REQUIRE(compact.size() > 10);
+  REQUIRE(compact.end(0) == tree->end);
+  REQUIRE(stream_to_string(compact) == stream_to_string(*tree));
+  REQUIRE(stream_to_string(CompactSyntaxTree(*tree)) == stream_to_string(*tree));
+  REQUIRE(g.interpreter.evaluate(compact) == Approx(5));
+
+  auto expression = g.interpreter.interpret(compact);
+  REQUIRE(expression.size() == 1);
+  REQUIRE(expression["Subtract"]);
+  REQUIRE(!expression["Add"]);
+  REQUIRE(expression[0].view() == input);
+
+  REQUIRE(!g.parser.parseCompact("+").valid);
+}
+
+TEST_CASE("File parsing") {
+  ParserGenerator<int> g;
+  g["Number"] << "[0-9]+" >> [](auto e) { return std::stoi(e.string()); };
+  g.setStart(g["Sum"] << "Number ('+' Number)*" >> [](auto e) {
+    int sum = 0;
+    for (auto n : e) {
+      sum += n.evaluate();
+    }
+    return sum;
+  });
+
+  std::string input = "1";
+  for (int i = 2; i <= 1000; ++i) {
+    input += "+" + std::to_string(i);
+  }
+  const std::string path = "peg_parser_file_test.txt";
+  std::ofstream(path, std::ios::binary) << input;
+
+  {
+    auto result = g.parser.parseFile(path);
+    REQUIRE(result.syntax->valid);
+    REQUIRE(result.syntax->view() == input);
+    REQUIRE(stream_to_string(*result.syntax) == stream_to_string(*g.parse(input)));
+  }
+  REQUIRE(g.runFile(path) == 500500);
+
+  std::ofstream(path, std::ios::binary) << "1+";
+  REQUIRE_THROWS_AS(g.runFile(path), SyntaxError);
+  std::ofstream(path, std::ios::binary).close();
+  REQUIRE(!g.parser.parseFile(path).syntax->valid);
+  std::remove(path.c_str());
+  REQUIRE_THROWS_AS(g.parser.parseFile(path), std::runtime_error);
+}
+
+TEST_CASE("Incremental parsing") {
+  size_t numbers = 0;
+  ParserGenerator<> g;
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Number"] << "'-'? [0-9]+" << [&](auto &) {
+    ++numbers;
+    return true;
+  };
+  g["Name"] << "[a-z]+";
+  g["List"] << "'[' (Value (',' Value)*)? ']'";
+  g["Call"] << "Name '(' Value ')'";
+  g["Value"] << "Number | Call | Name | List";
+  g["Sum"] << "Sum '+' Value | Value";
+  g.setStart(g["Statements"] << "(Sum ';')* <EOF>");
+
+  std::string input;
+  for (int i = 0; i < 200; ++i) {
+    input += "f([" + std::to_string(i) + ", x]) + " + std::to_string(i % 13) + ";";
+  }
+  auto result = g.parser.parseIncremental(input);
+  REQUIRE(result.syntax->valid);
+  REQUIRE(stream_to_string(*result.syntax) == stream_to_string(*g.parse(input)));
+
+  numbers = 0;
+  auto statement = input.find(';', input.size() / 2) + 1;
+  result = g.parser.reparse(std::move(result), Parser::Edit{statement, 0, "1+"});
+  input.insert(statement, "1+");
+  REQUIRE(numbers < 10);
+  REQUIRE(result.syntax->valid);
+  REQUIRE(result.syntax->view() == input);
+  REQUIRE(stream_to_string(*result.syntax) == stream_to_string(*g.parse(input)));
+
+  std::mt19937 random(42);
+  const std::string alphabet = "0123456789ab[](),;+ -";
+  for (int i = 0; i < 300; ++i) {
+    auto offset = random() % (input.size() + 1);
+    auto deleted = std::min<size_t>(random() % 4, input.size() - offset);
+    std::string inserted;
+    for (auto count = random() % 4; count > 0; --count) {
+      inserted += alphabet[random() % alphabet.size()];
+    }
+    result = g.parser.reparse(std::move(result), Parser::Edit{offset, deleted, inserted});
+    input.replace(offset, deleted, inserted);
+    auto expected = g.parse(input);
+    REQUIRE(result.syntax->valid == expected->valid);
+    REQUIRE(result.syntax->end == expected->end);
+    REQUIRE(stream_to_string(*result.syntax) == stream_to_string(*expected));
+  }
+
+  REQUIRE_THROWS_AS(g.parser.reparse(std::move(result), Parser::Edit{input.size() + 1, 0, ""}),
+                    std::out_of_range);
+  // rejected edits leave the previous result unchanged
+  REQUIRE(result.syntax);
+  REQUIRE(result.incremental);
+  // accepted edits consume it
+  auto edited = g.parser.reparse(std::move(result), Parser::Edit{0, 0, ""});
+  REQUIRE(stream_to_string(*edited.syntax) == stream_to_string(*g.parse(input)));
+  REQUIRE(!result.syntax);
+  REQUIRE(!result.incremental);
+  REQUIRE_THROWS_AS(g.parser.reparse(g.parser.parseAndGetError(input), Parser::Edit{0, 0, ""}),
+                    std::invalid_argument);
+
+  SECTION("left recursion") {
+    ParserGenerator<> c;
+    c.setSeparator(c["Whitespace"] << "[\t ]");
+    c["Sum"] << "Add | Subtract | Product";
+    c["Product"] << "Multiply | Atomic";
+    c["Add"] << "Sum '+' Product";
+    c["Subtract"] << "Sum '-' Product";
+    c["Multiply"] << "Product '*' Atomic";
+    c["Atomic"] << "Number | '(' Sum ')'";
+    c["Number"] << "[0-9]";
+    c.setStart(c["Sum"]);
+
+    auto calculation = c.parser.parseIncremental("1+1*");
+    calculation = c.parser.reparse(std::move(calculation), Parser::Edit{4, 0, "1"});
+    REQUIRE(calculation.syntax->end == 5);
+    REQUIRE(stream_to_string(*calculation.syntax) == stream_to_string(*c.parse("1+1*1")));
+
+    std::string expression;
+    const std::string symbols = "0123456789()+-*";
+    for (int i = 0; i < 3000; ++i) {
+      if (i % 30 == 0) {
+        expression = "(2*3+1)-4*5+6-7*8";
+        calculation = c.parser.parseIncremental(expression);
+      }
+      auto offset = random() % (expression.size() + 1);
+      auto deleted = std::min<size_t>(random() % 2, expression.size() - offset);
+      std::string inserted;
+      for (auto count = random() % 3; count > 0; --count) {
+        inserted += symbols[random() % symbols.size()];
+      }
+      auto edit = Parser::Edit{offset, deleted, inserted};
+      calculation = c.parser.reparse(std::move(calculation), edit);
+      expression.replace(offset, deleted, inserted);
+      auto expected = c.parse(expression);
+      REQUIRE(calculation.syntax->valid == expected->valid);
+      REQUIRE(calculation.syntax->end == expected->end);
+      REQUIRE(stream_to_string(*calculation.syntax) == stream_to_string(*expected));
+    }
+  }
+}
+
+TEST_CASE("Batch parsing") {
+  ParserGenerator<int> g;
+  g["Number"] << "[0-9]+" >> [](auto e) { return std::stoi(e.string()); };
+  g.setStart(g["Sum"] << "Number ('+' Number)*" >> [](auto e) {
+    int sum = 0;
+    for (auto n : e) {
+      sum += n.evaluate();
+    }
+    return sum;
+  });
+
+  std::vector<std::string> strings;
+  for (int i = 1; i <= 500; ++i) {
+    strings.push_back(i % 7 == 0 ? std::to_string(i) + "+" : "1+" + std::to_string(i));
+  }
+  std::vector<std::string_view> inputs(strings.begin(), strings.end());
+  ThreadPool pool(4);
+  REQUIRE(pool.size() == 4);
+
+  SECTION("parse") {
+    auto results = g.parser.parseBatch(inputs, pool);
+    REQUIRE(results.size() == inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      REQUIRE(results[i].syntax->fullString.data() == inputs[i].data());
+      REQUIRE(stream_to_string(*results[i].syntax) == stream_to_string(*g.parse(inputs[i])));
+    }
+  }
+
+  SECTION("run") {
+    auto results = g.runBatch(inputs, pool);
+    REQUIRE(results.size() == inputs.size());
+    for (int i = 1; i <= int(inputs.size()); ++i) {
+      auto &result = results[i - 1];
+      if (i % 7 == 0) {
+        REQUIRE(!result.value);
+        REQUIRE_THROWS_AS(result.get(), SyntaxError);
+      } else {
+        REQUIRE(result.get() == i + 1);
+      }
+    }
+    REQUIRE(g.runBatch({"1+2", "3"})[1].get() == 3);
+  }
+
+  SECTION("thread pool") {
+    std::vector<int> counts(1000);
+    std::vector<size_t> workers(counts.size()), nestedWorkers(counts.size());
+    pool.run(counts.size(), [&](size_t index, size_t worker) {
+      workers[index] = worker;
+      pool.run(2, [&](size_t, size_t nested) { nestedWorkers[index] += nested; });
+      ++counts[index];
+    });
+    REQUIRE(std::count(counts.begin(), counts.end(), 1) == int(counts.size()));
+    REQUIRE(*std::max_element(workers.begin(), workers.end()) < pool.size());
+    REQUIRE(std::count(nestedWorkers.begin(), nestedWorkers.end(), 0) == int(counts.size()));
+    REQUIRE_THROWS_AS(pool.run(100,
+                               [](size_t index, size_t) {
+                                 if (index == 50) {
+                                   throw std::runtime_error("failed");
+                                 }
+                               }),
+                      std::runtime_error);
+  }
+}
+
+TEST_CASE("Parallel parsing") {
+  ParserGenerator<> g;
+  g.setSeparator(g["Whitespace"] << "[\t \n]");
+  g["Number"] << "'-'? [0-9]+";
+  g["String"] << "'\"' (!'\"' .)* '\"'";
+  g["Value"] << "Number | String | Array";
+  g["Array"] << "'[' (Value (',' Value)*)? ']'";
+  g.setStart(g["Document"] << "Array <EOF>");
+  g.setSynchronization(g["Value"]);
+  g.parser.synchronization.chunkSize = 200;
+
+  std::string input = "[";
+  for (int i = 0; i < 1000; ++i) {
+    input += i > 0 ? ",\n" : "\n";
+    switch (i % 3) {
+      case 0:
+        input += std::to_string(i * 7919);
+        break;
+      case 1:
+        input += "\"a, [" + std::to_string(i) + "] \"";
+        break;
+      default:
+        input += "[" + std::to_string(i) + ", \"" + std::to_string(i) + "\"]";
+    }
+  }
+  input += "\n]";
+
+  ThreadPool pool(4);
+  auto sequential = g.parser.parseAndGetError(input);
+  REQUIRE(sequential.syntax->valid);
+  auto parallel = g.parser.parseParallel(input, pool);
+  REQUIRE(stream_to_string(*parallel.syntax) == stream_to_string(*sequential.syntax));
+
+  SECTION("candidates") {
+    g.parser.synchronization.findCandidate = [](std::string_view str, size_t position) {
+      auto found = str.find('\n', position);
+      return found == std::string_view::npos ? str.size() : found + 1;
+    };
+    parallel = g.parser.parseParallel(input, pool);
+    REQUIRE(stream_to_string(*parallel.syntax) == stream_to_string(*sequential.syntax));
+  }
+
+  SECTION("invalid input") {
+    input.insert(input.find(",\n", input.size() / 2), " 1");
+    parallel = g.parser.parseParallel(input, pool);
+    REQUIRE(!parallel.syntax->valid);
+    REQUIRE(!g.parser.parseAndGetError(input).syntax->valid);
+  }
+
+  SECTION("short input") {
+    REQUIRE(g.parser.parseParallel("[1, 2]", pool).syntax->valid);
+  }
+
+  SECTION("memory independent of the chunk positions") {
+    // every chunk only allocates the memo table for its own positions, so more chunks do not
+    // take more memory
+    input = "[";
+    for (int i = 0; i < 20000; ++i) {
+      input += (i > 0 ? ",\n" : "\n") + std::to_string(i * 7919);
+    }
+    input += "\n]";
+    g.parser.synchronization.chunkSize = 64;
+    auto measure = [&](size_t threads) {
+      ThreadPool chunkPool(threads);
+      auto before = allocatedBytes.load();
+      REQUIRE(g.parser.parseParallel(input, chunkPool).syntax->valid);
+      return allocatedBytes.load() - before;
+    };
+    auto few = measure(2);
+    auto many = measure(32);
+    REQUIRE(many < few + few / 4);
+  }
+}
+
+TEST_CASE("Frozen parser") {
+  ParserGenerator<int> g;
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Number"] << "[0-9]+" >> [](auto e) { return std::stoi(e.string()); };
+  g.setStart(g["Sum"] << "Number ('+' Number)*" >> [](auto e) {
+    int sum = 0;
+    for (auto n : e) {
+      sum += n.evaluate();
+    }
+    return sum;
+  });
+
+  auto frozen = g.parser.freeze();
+  auto number = g.getRule("Number");
+  auto references = number.use_count();
+  {
+    auto result = frozen.parseAndGetError("1 + 2 + 3");
+    REQUIRE(result.syntax->valid);
+    REQUIRE(result.syntax->inner[1]->rule == number);
+    REQUIRE(result.syntax->inner[1]->rule.use_count() == 0);
+    REQUIRE(number.use_count() == references);
+    REQUIRE(stream_to_string(*result.syntax) == stream_to_string(*g.parse("1 + 2 + 3")));
+    REQUIRE(g.interpreter.evaluate(result.syntax) == 6);
+    REQUIRE(!frozen.parse("+")->valid);
+  }
+
+  g["Number"] << "[0-9]+ '.'?";
+  REQUIRE(g.parse("1.+2")->end == 4);
+  REQUIRE(frozen.parse("1 + 2")->valid);
+  REQUIRE(frozen.parse("1.+2")->end == 1);
+  references = number.use_count();
+
+  std::vector<std::string> inputs, outputs(200);
+  for (int i = 0; i < 200; ++i) {
+    inputs.push_back(std::to_string(i) + " + " + std::to_string(i * i));
+  }
+  ThreadPool pool(4);
+  pool.run(inputs.size(), [&](size_t index, size_t) {
+    outputs[index] = stream_to_string(*frozen.parse(inputs[index]));
+  });
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    REQUIRE(outputs[i] == stream_to_string(*frozen.parse(inputs[i])));
+  }
+  REQUIRE(number.use_count() == references);
+}
+
+TEST_CASE("Parse context") {
+  ParserGenerator<int> g;
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Number"] << "[0-9]+" >> [](auto e) { return std::stoi(e.string()); };
+  g.setStart(g["Sum"] << "Number ('+' Number)*" >> [](auto e) {
+    int sum = 0;
+    for (auto n : e) {
+      sum += n.evaluate();
+    }
+    return sum;
+  });
+
+  ParseContext context;
+  std::vector<std::string> inputs;
+  inputs.reserve(100);
+  std::vector<std::shared_ptr<SyntaxTree>> trees;
+  for (int i = 0; i < 100; ++i) {
+    inputs.push_back(std::to_string(i) + " + " + std::to_string(i * i)
+                     + (i % 10 == 0 ? "+" : ""));
+    auto &input = inputs.back();
+    auto result = g.parser.parseAndGetError(input, context);
+    REQUIRE(stream_to_string(*result.syntax) == stream_to_string(*g.parse(input)));
+    trees.push_back(result.syntax);
+    if (i % 10 == 0) {
+      REQUIRE_THROWS_AS(g.run(input, context), SyntaxError);
+    } else {
+      REQUIRE(g.run(input, context) == i + i * i);
+    }
+  }
+  REQUIRE(trees[1]->view() == "1 + 1");
+
+  SECTION("grammar modifications") {
+    g["Number"] << "'-'? [0-9]+" >> [](auto e) { return std::stoi(e.string()); };
+    REQUIRE(g.run("-1 + 3", context) == 2);
+  }
+
+  SECTION("inputs of different lengths") {
+    g.parser.memoization = MemoizationPolicy::full();
+    auto sum = [](int count, int step) {
+      std::string input = "0";
+      for (int i = 1; i < count; ++i) {
+        input += " + " + std::to_string(i * step);
+      }
+      return input;
+    };
+    auto longInput = sum(1000, 1), shortInput = sum(3, 1), otherInput = sum(1000, 7);
+    REQUIRE(g.run(longInput, context) == 999 * 1000 / 2);
+    REQUIRE(g.run(shortInput, context) == 3);
+    auto result = g.parser.parseAndGetError(otherInput, context);
+    REQUIRE(stream_to_string(*result.syntax) == stream_to_string(*g.parse(otherInput)));
+    REQUIRE(g.run(otherInput, context) == 7 * 999 * 1000 / 2);
+  }
+
+  SECTION("frozen parser") {
+    auto frozen = g.parser.freeze();
+    REQUIRE(frozen.parse("1 + 2", context)->end == 5);
+    REQUIRE(!frozen.parse("+", context)->valid);
+    REQUIRE(g.run("1 + 2", context) == 3);
+  }
+}
+
+TEST_CASE("Error diagnosis") {
+  ParserGenerator<int> g;
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Number"] << "[0-9]+" >> [](auto e) { return std::stoi(e.string()); };
+  g["Atomic"] << "Number | '(' Sum ')'" >> [](auto e) { return e[0].evaluate(); };
+  g.setStart(g["Sum"] << "Atomic ('+' Atomic)*" >> [](auto e) {
+    int sum = 0;
+    for (auto n : e) {
+      sum += n.evaluate();
+    }
+    return sum;
+  });
+
+  auto diagnosis = g.parser.diagnose("1 + 2 + x");
+  REQUIRE(diagnosis.position == 8);
+  REQUIRE(diagnosis.terminals == std::vector<std::string>{"[0-9]", "'('"});
+  REQUIRE(std::find(diagnosis.rules.begin(), diagnosis.rules.end(), g.getRule("Number"))
+          != diagnosis.rules.end());
+  REQUIRE(std::find(diagnosis.rules.begin(), diagnosis.rules.end(), g.getRule("Whitespace"))
+          == diagnosis.rules.end());
+  // errors are only diagnosed on request
+  try {
+    g.run("1 + (2 3");
+    FAIL("expected a syntax error");
+  } catch (SyntaxError &error) {
+    REQUIRE(!error.diagnosis);
+    REQUIRE(error.syntax->rule == g.getRule("Atomic"));
+    REQUIRE(error.syntax->end == 7);
+  }
+  g.diagnoseErrors = true;
+  REQUIRE_THROWS_WITH(g.run("1 + 2 + x"),
+                      "syntax error at character 9 while parsing Sum, expected [0-9] or '('");
+
+  diagnosis = g.parser.diagnose("1 + (2 3");
+  REQUIRE(diagnosis.position == 7);
+  REQUIRE(diagnosis.terminals == std::vector<std::string>{"'+'", "')'"});
+
+  try {
+    g.run("1 + 2 3");
+    FAIL("expected a syntax error");
+  } catch (SyntaxError &error) {
+    REQUIRE(error.diagnosis);
+    REQUIRE(error.diagnosis->position == 6);
+    REQUIRE(error.diagnosis->terminals == std::vector<std::string>{"'+'"});
+  }
+}
+
+TEST_CASE("Evaluator dispatch") {
+  ParserGenerator<int> g;
+  auto first = g["First"].operator std::shared_ptr<grammar::Rule>();
+
+  int offset = 100;
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Sum"] << "Number ('+' Number)*" >> [](auto e) {
+    int sum = 0;
+    for (auto n : e) {
+      sum += n.evaluate();
+    }
+    return sum;
+  };
+  g["Number"] << "[0-9]+" >> [&](auto e) { return std::stoi(e.string()) + offset; };
+  g.setStart(g["Sum"]);
+  REQUIRE(g.run("1 + 2") == 203);
+
+  SECTION("evaluators of earlier rules") {
+    g.interpreter.setEvaluator(first, [](auto) { return 0; });
+    REQUIRE(g.run("1 + 2") == 203);
+  }
+
+  SECTION("removed evaluators") {
+    g.interpreter.setEvaluator(g["Number"], nullptr);
+    REQUIRE_THROWS_AS(g.run("1 + 2"), InterpreterError);
+  }
+
+  SECTION("slots independent of other grammars") {
+    std::vector<ParserGenerator<int>> others(100);
+    for (auto &other : others) {
+      other["Rule"] << "'a'" >> [](auto) { return 0; };
+    }
+    auto rule = (g["Product"] << "Number '*' Number" >> [](auto e) {
+                   return e[0].evaluate() * e[1].evaluate();
+                 }).operator std::shared_ptr<grammar::Rule>();
+    REQUIRE(rule->slot < 4);
+  }
+
+  SECTION("rules shared with another interpreter") {
+    Interpreter<int> other;
+    auto number = g["Number"].operator std::shared_ptr<grammar::Rule>();
+    other.setEvaluator(number, [](auto e) { return -std::stoi(e.string()); });
+    auto expression = g.interpret(g.parse("1 + 2"));
+    REQUIRE(expression[0].evaluateBy(other) == -1);
+    REQUIRE(expression[0].evaluate() == 101);
+    other.setEvaluator(number, nullptr);
+    REQUIRE_THROWS_AS(expression[0].evaluateBy(other), InterpreterError);
+  }
+
+  SECTION("subexpressions") {
+    auto tree = g.parse("1 + 2");
+    auto expression = g.interpret(tree);
+    auto number = expression[1];
+    REQUIRE(number.view() == "2");
+    REQUIRE(number.syntax() == tree->inner[1]);
+    REQUIRE(expression["Number"]->position() == 0);
+
+    // subexpressions own their tree and may outlive their root
+    auto leading = g.interpret(g.parse("3 + 4"))[0];
+    REQUIRE(leading.view() == "3");
+    REQUIRE(leading.evaluate() == 103);
+  }
+}
+
+TEST_CASE("Labeled captures") {
+  ParserGenerator<std::string> g;
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Name"] << "[a-z]+" >> [](auto e) { return e.string(); };
+  g["Number"] << "[0-9]+" >> [](auto e) { return e.string(); };
+  g["Pair"] << "key:Name ':' value:Number" >> [](auto e) {
+    return e["key"]->evaluate() + "=" + e["value"]->evaluate();
+  };
+  g["Declaration"] << "type:Name name:Name value:('=' Number)? ';'" >> [](auto e) {
+    auto value = e["value"];
+    return e["name"]->evaluate() + ":" + e["type"]->evaluate() + "="
+           + (value ? value->evaluate() : "0");
+  };
+  g["List"] << "Name* ',' last:Number" >> [](auto e) { return e["last"]->evaluate(); };
+  g.setStart(g["Start"] << "Pair | Declaration | List");
+
+  REQUIRE(g.run("abc: 42") == "abc=42");
+  REQUIRE(g.run("int x = 3;") == "x:int=3");
+  REQUIRE(g.run("int x;") == "x:int=0");
+  REQUIRE(g.run("a b c, 7") == "7");
+  REQUIRE(stream_to_string(*g["Pair"]->node).find("key:") != std::string::npos);
+
+  auto tree = g.parse("int x = 3;");
+  auto declaration = g.interpret(tree)[0];
+  REQUIRE(declaration["Name"]->view() == "int");
+  REQUIRE(declaration[*g["Declaration"]->findLabel("value")]->view() == "3");
+  REQUIRE(!g["Declaration"]->findLabel("Name"));
+
+  auto compact = g.parser.parseCompact("abc: 42");
+  REQUIRE(g.interpreter.interpret(compact)[0]["value"]->view() == "42");
+
+  REQUIRE_THROWS_AS(g.setRule("Invalid", "items:Name*"), Parser::GrammarError);
+  REQUIRE_THROWS_AS(g.setRule("Invalid", "(item:Name)*"), Parser::GrammarError);
+  REQUIRE_THROWS_AS(g.setRule("Invalid", "a:Name? b:Number?"), Parser::GrammarError);
+  REQUIRE_THROWS_AS(g.setRule("Invalid", "Name* a:Number Name*"), Parser::GrammarError);
+
+  // rules are only rejected once they are set or compiled
+  auto invalid = grammar::makeRule("Invalid", g.parseRule("items:Name*"));
+  REQUIRE_THROWS_AS(Parser::parse("a", invalid), Parser::GrammarError);
+
+  SECTION("rules hidden after the labeled rule is set") {
+    g["Sign"] << "'-'";
+    g.setStart(g["Signed"] << "Name Sign value:Number Name" >> [](auto e) {
+      return e["value"]->evaluate();
+    });
+    REQUIRE(g.run("a - 4 b") == "4");
+    g["Sign"]->hidden = true;
+    REQUIRE(g.run("a - 4 b") == "4");
+    // the grammar is not modified, the compiled program holds the labels
+    REQUIRE(g["Signed"]->findLabel("value")->offset == 2);
+    auto labels = g.parser.getProgram()->getLabels(*g.getRule("Signed"));
+    REQUIRE(grammar::findLabel(*labels, "value")->offset == 1);
+    g["Sign"]->hidden = false;
+    g["Signed"]->node = g.parseRule("Name value:Number Sign Name");
+    REQUIRE(g.run("a 4 - b") == "4");
+  }
+}
+
+namespace {
+
+  constexpr auto staticNumber = static_grammar::compile("'-'? [0-9]+ ('.' [0-9]+)?");
+  constexpr auto staticSum = static_grammar::compile(R"(
+    Sum <- first:Product ('+' Product)*
+    Product <- Atomic ('*' Atomic)*
+    Atomic <- Number | '(' Sum ')'
+    Number <- [0-9]+
+  )");
+
+  static_assert(static_grammar::match<staticNumber>("-12.5x") == 5);
+  static_assert(!static_grammar::match<staticNumber>("x"));
+  static_assert(static_grammar::match<staticSum>("1+2*(3+4)") == 9);
+
+  constexpr auto staticLists = static_grammar::compile("('a' | 'b' ('c' | 'd') 'e' | 'f') 'g'");
+  static_assert(staticLists.childCount == 10);
+  static_assert(static_grammar::match<staticLists>("bdeg") == 4);
+  static_assert(static_grammar::match<staticLists>("fg") == 2);
+  static_assert(!static_grammar::match<staticLists>("bcg"));
+
+}  // namespace
+
+TEST_CASE("Static grammar") {
+  REQUIRE(static_grammar::match<staticNumber>("42") == 2);
+  REQUIRE(static_grammar::match<staticSum>("1+") == 1);
+  REQUIRE(static_grammar::rules<staticSum>().size() == 4);
+
+  ParserGenerator<int> g;
+  g["Sum"] << "Product ('+' Product)*";
+  g["Product"] << "Atomic ('*' Atomic)*";
+  g["Atomic"] << "Number | '(' Sum ')'";
+  g["Number"] << "[0-9]+";
+  g.setStart(g["Sum"]);
+
+  auto input = "1+2*(3+4)";
+  auto tree = static_grammar::parse<staticSum>(input);
+  REQUIRE(tree->valid);
+  REQUIRE(tree->end == 9);
+  REQUIRE(stream_to_string(*tree) == stream_to_string(*g.parse(input)));
+  REQUIRE(!static_grammar::parse<staticSum>("+")->valid);
+
+  Interpreter<int> interpreter;
+  interpreter.setEvaluator(static_grammar::getRule<staticSum>("Sum"), [](auto e) {
+    int sum = 0;
+    for (auto p : e) {
+      sum += p.evaluate();
+    }
+    return sum;
+  });
+  interpreter.setEvaluator(static_grammar::getRule<staticSum>("Product"), [](auto e) {
+    int product = 1;
+    for (auto a : e) {
+      product *= a.evaluate();
+    }
+    return product;
+  });
+  interpreter.setEvaluator(static_grammar::getRule<staticSum>("Number"),
+                           [](auto e) { return std::stoi(e.string()); });
+  REQUIRE(interpreter.evaluate(tree) == 15);
+  REQUIRE(interpreter.interpret(tree)["first"]->view() == "1");
+
+  SECTION("runtime grammars") {
+    g.setRule("Number", grammar::Node::Rule(static_grammar::getRule<staticNumber>("Start")));
+    REQUIRE(g.parse("1+-2.5")->end == 6);
+  }
+
+  SECTION("invalid grammars") {
+    REQUIRE_THROWS_AS(static_grammar::compile("'a' |"), std::invalid_argument);
+    REQUIRE_THROWS_AS(static_grammar::compile("A <- B\nB <- 'b'? A"), std::invalid_argument);
+    REQUIRE_THROWS_AS(static_grammar::compile("A <- B"), std::invalid_argument);
+  }
+}
+
+TEST_CASE("Fused evaluation") {
+  ParserGenerator<int> g;
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Sum"] << "Sum '+' Product | Sum '-' Product | Product" >> [](auto e) {
+    if (e.size() == 1) {
+      return e[0].evaluate();
+    }
+    return e.view()[e[1].position() - e.position() - 2] == '+' ? e[0].evaluate() + e[1].evaluate()
+                                                               : e[0].evaluate() - e[1].evaluate();
+  };
+  g["Product"] << "Atomic ('*' Atomic)*" >> [](auto e) {
+    int product = 1;
+    for (auto a : e) {
+      product *= a.evaluate();
+    }
+    return product;
+  };
+  g["Atomic"] << "Number | '(' Sum ')'";
+  g["Number"] << "[0-9]+" >> [](auto e) { return std::stoi(e.string()); };
+  g.setStart(g["Sum"]);
+
+  for (auto input : {"1", "1 + 2 * 3", "2 * (3 - 1) - 4", "10 - 2 - 3", "(((7)))"}) {
+    REQUIRE(g.runFused(input) == g.run(input));
+  }
+  REQUIRE(g.runFused("10 - 2 - 3") == 5);
+  REQUIRE_THROWS_AS(g.runFused("1 +"), SyntaxError);
+
+  ParseContext context;
+  REQUIRE(g.runFused("2 * 3 + 1", context) == 7);
+  REQUIRE(g.runFused("2 * (3 + 1)", context) == 8);
+
+  SECTION("value stack") {
+    Interpreter<int>::Reducer reducer(g.interpreter, "1 + 2");
+    auto parsed = g.parser.parseAndReduce("1 + 2", reducer);
+    REQUIRE(parsed.syntax->valid);
+    REQUIRE(parsed.syntax->inner.empty());
+    REQUIRE(reducer.interpret(*parsed.syntax).evaluate() == 3);
+  }
+
+  SECTION("values that cannot be copied") {
+    ParserGenerator<std::unique_ptr<int>> h;
+    h["Number"] << "[0-9]+" >> [](auto e) { return std::make_unique<int>(std::stoi(e.string())); };
+    h["Sum"] << "Sum '+' Number | Number" >> [](auto e) {
+      auto value = e[0].evaluate();
+      if (e.size() == 2) {
+        *value += *e[1].evaluate();
+      }
+      return value;
+    };
+    h["Start"] << "Number '!' | Sum" >> [](auto e) { return e[0].evaluate(); };
+    h.setStart(h["Start"]);
+    REQUIRE(*h.run("1+2+3") == 6);
+    REQUIRE(*h.runFused("1+2+3") == 6);
+    REQUIRE(*h.runFused("4!") == 4);
+  }
+
+  SECTION("backtracking") {
+    ParserGenerator<std::string> h;
+    h["Name"] << "[a-z]+" >> [](auto e) { return e.string(); };
+    h["Call"] << "Name '(' Name ')'" >> [](auto e) {
+      return e[0].evaluate() + "<" + e[1].evaluate() + ">";
+    };
+    h["Start"] << "Call | Name '!'" >> [](auto e) { return e[0].evaluate(); };
+    h.setStart(h["Start"]);
+    REQUIRE(h.runFused("f(x)") == "f<x>");
+    REQUIRE(h.runFused("f!") == "f");
+    REQUIRE_THROWS_AS(h.runFused("f(x"), SyntaxError);
+  }
+
+  SECTION("memoized rules") {
+    ParserGenerator<int> h;
+    int evaluations = 0;
+    h["Number"] << "[0-9]+" >> [&](auto e) {
+      ++evaluations;
+      return std::stoi(e.string());
+    };
+    h["Start"] << "Number 'a' | Number 'b'" >> [](auto e) { return e[0].evaluate() + 1; };
+    h.setStart(h["Start"]);
+    REQUIRE(h.runFused("41b") == 42);
+    REQUIRE(evaluations == 1);
+
+    // the parent consuming the memoized value is discarded
+    h["Negative"] << "Number" >> [](auto e) { return -e[0].evaluate(); };
+    h["Start"] << "Negative 'a' | Number 'b'" >> [](auto e) { return e[0].evaluate() + 1; };
+    evaluations = 0;
+    REQUIRE(h.runFused("41b") == 42);
+    REQUIRE(evaluations == 1);
+  }
+
+  SECTION("rules without evaluators") {
+    ParserGenerator<std::string> h;
+    h.setSeparator(h["Whitespace"] << "[\t ]");
+    h["Name"] << "[a-z]+" >> [](auto e) { return e.string(); };
+    h["Pair"] << "key:Name ':' value:Name";
+    h["List"] << "Pair (',' Pair)*" >> [](auto e) {
+      std::string result;
+      for (auto pair : e) {
+        result += pair["value"]->evaluate() + pair["key"]->evaluate();
+      }
+      return result;
+    };
+    h.setStart(h["List"]);
+    REQUIRE(h.runFused("a: b, c: d") == "badc");
+  }
+
+  SECTION("void evaluators") {
+    std::vector<std::string> names;
+    ParserGenerator<void, std::vector<std::string> &> h;
+    h["Name"] << "[a-z]+" >> [](auto e, auto &n) { n.push_back(e.string()); };
+    h["List"] << "Name (',' Name)*" >> [](auto e, auto &n) {
+      for (auto name : e) {
+        name.evaluate(n);
+      }
+      n.push_back("end");
+    };
+    h.setStart(h["List"]);
+    h.runFused("a,b", names);
+    REQUIRE(names == std::vector<std::string>{"a", "b", "end"});
+  }
+}
+
+TEST_CASE("Parallel evaluation") {
+  ThreadPool pool(4);
+  ParserGenerator<std::vector<int>> g;
+  g.setSeparator(g["Whitespace"] << "[\t ]");
+  g["Number"] << "[0-9]+" >> [](auto e) { return std::vector<int>{std::stoi(e.string())}; };
+  g["List"] << "'[' (Value (',' Value)*)? ']'" >> [&](auto e) {
+    std::vector<int> result;
+    for (auto &values : e.parallelMap([](auto v) { return v.evaluate(); }, 0, pool)) {
+      result.insert(result.end(), values.begin(), values.end());
+    }
+    return result;
+  };
+  g["Value"] << "Number | List";
+  g.setStart(g["List"]);
+
+  std::string input = "[";
+  std::vector<int> expected;
+  for (int i = 0; i < 1000; ++i) {
+    auto number = std::to_string(i);
+    input += (i > 0 ? ", " : "") + (i % 10 == 0 ? "[" + number + "]" : number);
+    expected.push_back(i);
+  }
+  input += "]";
+  REQUIRE(g.run(input) == expected);
+  REQUIRE(g.run("[]").empty());
+
+  auto tree = g.parse(input);
+  auto expression = g.interpret(tree);
+
+  SECTION("threshold") {
+    auto ids = expression.parallelMap(
+        [](auto) { return std::this_thread::get_id(); }, input.size() + 1, pool);
+    REQUIRE(std::count(ids.begin(), ids.end(), std::this_thread::get_id()) == 1000);
+  }
+
+  SECTION("ordered results") {
+    auto positions = expression.parallelMap([](auto e) { return e.position(); }, 0, pool);
+    REQUIRE(positions.size() == 1000);
+    REQUIRE(std::is_sorted(positions.begin(), positions.end()));
+    auto views = expression.parallelMap([](auto e) { return e.view(); }, 0, pool);
+    REQUIRE(views[3] == "3");
+    REQUIRE(views[10] == "[10]");
+  }
+
+  SECTION("results without default constructor") {
+    struct Value {
+      size_t length;
+      explicit Value(size_t l) : length(l) {}
+    };
+    auto values = expression.parallelMap([](auto e) { return Value(e.length()); }, 0, pool);
+    REQUIRE(values[999].length == 3);
+  }
+
+  SECTION("errors") {
+    REQUIRE_THROWS_AS(expression.parallelMap(
+                          [](auto e) {
+                            if (e.view() == "[500]") {
+                              throw std::runtime_error("error");
+                            }
+                          },
+                          0, pool),
+                      std::runtime_error);
+  }
+
+  SECTION("shared pool") { REQUIRE(expression.parallelEvaluate().size() == 1000); }
+}